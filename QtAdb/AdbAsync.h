@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QtConcurrent/QtConcurrentRun>
+#include <QFuture>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <QDeadlineTimer>
+#include <QSharedPointer>
+#include <QAtomicInt>
+
+// 取消标记，可附带超时，供后台任务中的等待循环检查
+// 拷贝之间共享同一状态，界面线程调用cancel()即可通知后台任务退出
+class CancelToken
+{
+public:
+    CancelToken(int timeout = 0): d(new Data)
+    {
+        if (timeout > 0) d->deadline.setRemainingTime(timeout);
+    }
+
+    void cancel() { d->cancelled.storeRelease(1); }
+
+    bool cancelled() const
+    {
+        return d->cancelled.loadAcquire() || d->deadline.hasExpired();
+    }
+
+private:
+    struct Data
+    {
+        QAtomicInt cancelled = 0;
+        QDeadlineTimer deadline = QDeadlineTimer(QDeadlineTimer::Forever);
+    };
+    QSharedPointer<Data> d;
+};
+
+// 后台执行adb操作，结果通过回调回到界面线程
+struct Async
+{
+    // adb操作专用的线程池，避免长时间的等待占满全局线程池
+    static QThreadPool *pool()
+    {
+        static QThreadPool *p = [] {
+            auto p = new QThreadPool();
+            p->setMaxThreadCount(16);
+            p->setExpiryTimeout(60 * 1000);
+            return p;
+        }();
+        return p;
+    }
+
+    template<class F>
+    static auto run(F f) -> QFuture<decltype(f())>
+    {
+        return QtConcurrent::run(pool(), f);
+    }
+
+    // 任务完成后在ctx所在线程调用cb，ctx销毁后不再回调
+    template<class T, class F>
+    static void then(QObject *ctx, const QFuture<T>& future, F cb)
+    {
+        auto w = new QFutureWatcher<T>(ctx);
+        QObject::connect(w, &QFutureWatcher<T>::finished, ctx, [w, cb]() {
+            w->deleteLater();
+            if (!w->isCanceled()) cb(w->result());
+        });
+        w->setFuture(future);
+    }
+
+    template<class F>
+    static void then(QObject *ctx, const QFuture<void>& future, F cb)
+    {
+        auto w = new QFutureWatcher<void>(ctx);
+        QObject::connect(w, &QFutureWatcher<void>::finished, ctx, [w, cb]() {
+            w->deleteLater();
+            cb();
+        });
+        w->setFuture(future);
+    }
+};
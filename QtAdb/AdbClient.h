@@ -0,0 +1,313 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QProcess>
+#include <QtEndian>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+#include <errno.h>
+
+// 与adb server之间的一条阻塞式TCP连接，不依赖事件循环，可在任意线程使用
+class AdbSocket
+{
+public:
+#ifdef _WIN32
+    typedef SOCKET Handle;
+    static Handle invalid() { return INVALID_SOCKET; }
+#else
+    typedef int Handle;
+    static Handle invalid() { return -1; }
+#endif
+
+    AdbSocket() {}
+    AdbSocket(const AdbSocket&) = delete;
+    AdbSocket& operator=(const AdbSocket&) = delete;
+    ~AdbSocket() { close(); }
+
+    // 默认不设接收超时，需要超时的调用者自行setTimeout
+    bool connect(quint16 port)
+    {
+        startup();
+        close();
+        fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (fd == invalid()) return false;
+
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // 接收超时(毫秒)，0表示一直等待
+    void setTimeout(int ms)
+    {
+#ifdef _WIN32
+        DWORD t = ms;
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&t, sizeof(t));
+#else
+        timeval t = { ms / 1000, (ms % 1000) * 1000 };
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t));
+#endif
+    }
+
+    // 收发缓冲区大小，大块传输时调大以保持链路满载
+    void setBufferSize(int bytes)
+    {
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (const char*)&bytes, sizeof(bytes));
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char*)&bytes, sizeof(bytes));
+    }
+
+    bool isOpen() const { return fd != invalid(); }
+
+    // 关闭读写但保留句柄，其他线程中阻塞的read随之返回；句柄仍由使用它的线程关闭
+    void shutdown()
+    {
+        if (!isOpen()) return;
+#ifdef _WIN32
+        ::shutdown(fd, SD_BOTH);
+#else
+        ::shutdown(fd, SHUT_RDWR);
+#endif
+    }
+
+    void close()
+    {
+        if (!isOpen()) return;
+#ifdef _WIN32
+        ::closesocket(fd);
+#else
+        ::close(fd);
+#endif
+        fd = invalid();
+    }
+
+    bool write(const char *p, int n)
+    {
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        while (n > 0)
+        {
+            int r = ::send(fd, p, n, flags);
+            if (r <= 0) return false;
+            p += r, n -= r;
+        }
+        return true;
+    }
+
+    bool write(const QByteArray& data) { return write(data.constData(), data.size()); }
+
+    // 读取部分数据，返回0表示对端已关闭，小于0表示出错或超时
+    int read(char *p, int n) { return ::recv(fd, p, n, 0); }
+
+    // 等待数据到达，ms毫秒内没有可读的数据时返回false；连接关闭或出错也算可读，由随后的read报告
+    // 需要反复等待的流用它代替SO_RCVTIMEO，Winsock在接收超时之后套接字的状态是不确定的
+    bool waitReadable(int ms)
+    {
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(fd, &set);
+        timeval t = { ms / 1000, (ms % 1000) * 1000 };
+        return ::select(int(fd + 1), &set, nullptr, nullptr, &t) != 0;
+    }
+
+    bool readFully(char *p, int n)
+    {
+        while (n > 0)
+        {
+            int r = read(p, n);
+            if (r <= 0) return false;
+            p += r, n -= r;
+        }
+        return true;
+    }
+
+    // 读取直到对端关闭连接，出错或超时时ok为false，返回已收到的部分
+    QByteArray readToEnd(bool *ok = nullptr)
+    {
+        QByteArray data;
+        char buf[64 * 1024];
+        int r;
+        while ((r = read(buf, sizeof(buf))) > 0)
+            data.append(buf, r);
+        if (ok) *ok = r == 0;
+        return data;
+    }
+
+private:
+    static void startup()
+    {
+#ifdef _WIN32
+        static bool ok = [] {
+            WSADATA d;
+            return WSAStartup(MAKEWORD(2, 2), &d) == 0;
+        }();
+        (void)ok;
+#endif
+    }
+
+    Handle fd = invalid();
+};
+
+// adb server 智能套接字(smart socket)协议客户端
+//  请求: 4位十六进制长度 + 服务名，如 "000chost:version"
+//  应答: "OKAY"，或 "FAIL" + 4位十六进制长度 + 错误信息
+class AdbClient
+{
+public:
+    // shell v2 协议数据包类型: 1字节id + 4字节小端长度 + 数据
+    enum ShellPacket { StdIn = 0, StdOut = 1, StdErr = 2, Exit = 3, CloseStdIn = 4, WindowSizeChange = 5 };
+
+    // adb server 端口，与adb.exe一样支持环境变量 ANDROID_ADB_SERVER_PORT
+    static quint16 port()
+    {
+        static quint16 p = [] {
+            bool ok = false;
+            auto v = qgetenv("ANDROID_ADB_SERVER_PORT").toUShort(&ok);
+            return ok ? v : quint16(5037);
+        }();
+        return p;
+    }
+
+    // 连接adb server，连接不上时启动server后重试
+    static bool connect(AdbSocket& s)
+    {
+        if (s.connect(port())) return true;
+#ifdef _WIN32
+        QProcess::execute("adb.exe", QStringList{ "start-server" });
+#else
+        QProcess::execute("adb", QStringList{ "start-server" });
+#endif
+        return s.connect(port());
+    }
+
+    // 发送服务请求并读取应答状态
+    static bool request(AdbSocket& s, const QByteArray& service, QString *err = nullptr)
+    {
+        auto len = QByteArray::number(service.size(), 16).rightJustified(4, '0');
+        if (!s.write(len + service)) return fail(err, "send request failed: " + service);
+
+        char status[4];
+        if (!s.readFully(status, 4)) return fail(err, "no response: " + service);
+        if (memcmp(status, "OKAY", 4) == 0) return true;
+        if (memcmp(status, "FAIL", 4) == 0) return fail(err, readBlock(s));
+        return fail(err, "bad response: " + QByteArray(status, 4));
+    }
+
+    // 读取 4位十六进制长度 + 数据 格式的数据块
+    static QByteArray readBlock(AdbSocket& s)
+    {
+        char len[4];
+        if (!s.readFully(len, 4)) return QByteArray();
+        bool ok = false;
+        int n = QByteArray(len, 4).toInt(&ok, 16);
+        if (!ok) return QByteArray();
+
+        QByteArray data(n, Qt::Uninitialized);
+        if (!s.readFully(data.data(), n)) return QByteArray();
+        return data;
+    }
+
+    // 切换到指定设备并打开其上的服务，serial为空时使用任意一台设备
+    static bool open(AdbSocket& s, const QString& serial, const QByteArray& service, QString *err = nullptr)
+    {
+        if (!connect(s)) return fail(err, "cannot connect to adb server");
+        auto transport = serial.isEmpty() ? QByteArray("host:transport-any")
+                                          : "host:transport:" + serial.toUtf8();
+        return request(s, transport, err) && request(s, service, err);
+    }
+
+    // host服务查询，如 host:devices、host:version
+    static QByteArray query(const QByteArray& service, QString *err = nullptr)
+    {
+        AdbSocket s;
+        if (!connect(s)) { fail(err, "cannot connect to adb server"); return QByteArray(); }
+        if (!request(s, service, err)) return QByteArray();
+        return readBlock(s);
+    }
+
+    // 设备支持的特性，如 shell_v2、stat_v2、ls_v2，查询失败时err不为空
+    static QStringList features(const QString& serial, QString *err = nullptr)
+    {
+        QString e;
+        auto r = query("host-serial:" + serial.toUtf8() + ":features", &e);
+        if (err) *err = e;
+        return e.isEmpty() ? QString::fromUtf8(r).split(',', QString::SkipEmptyParts) : QStringList();
+    }
+
+    // 执行shell命令，返回标准输出
+    //  v2: 使用shell v2协议，可拿到退出码，标准错误单独返回
+    //  ok: 命令是否执行完毕、输出完整，v1没有退出码，只能以连接正常关闭为准
+    static QByteArray shell(const QString& serial, const QByteArray& cmd, bool v2 = true,
+                            int *code = nullptr, QByteArray *errOut = nullptr, bool *ok = nullptr)
+    {
+        if (ok) *ok = false;
+        AdbSocket s;
+        if (!open(s, serial, (v2 ? "shell,v2,raw:" : "shell:") + cmd)) return QByteArray();
+        if (!v2) return s.readToEnd(ok);
+
+        int c = -1;
+        auto out = readShellV2(s, &c, errOut);
+        if (code) *code = c;
+        if (ok) *ok = c >= 0;
+        return out;
+    }
+
+    // 解析shell v2数据流，直到收到退出码
+    static QByteArray readShellV2(AdbSocket& s, int *code = nullptr, QByteArray *errOut = nullptr)
+    {
+        QByteArray out;
+        char hdr[5];
+        while (s.readFully(hdr, 5))
+        {
+            auto len = qFromLittleEndian<quint32>(hdr + 1);
+            QByteArray data(int(len), Qt::Uninitialized);
+            if (!s.readFully(data.data(), data.size())) break;
+
+            switch (hdr[0])
+            {
+            case StdOut: out += data; break;
+            case StdErr: if (errOut) *errOut += data; break;
+            case Exit:
+                if (code && data.size()) *code = (uchar)data[0];
+                return out;
+            }
+        }
+        return out;
+    }
+
+private:
+    static bool fail(QString *err, const QByteArray& msg)
+    {
+        if (err) *err = QString::fromUtf8(msg);
+        return false;
+    }
+};
@@ -8,20 +8,28 @@
 #include <QMessageBox>
 #include <QDir>
 #include <QFileInfo>
-#include <QProcess>
 #include <QRegExp>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QXmlStreamReader>
-
-#include <Windows.h>
-#include <shellscalingapi.h>
-
+#include <QAtomicInt>
+#include <QMutex>
+#include <QVector>
+#include <QScopedPointer>
+
+#include "AdbClient.h"
+#include "ShellSession.h"
+#include "AdbSync.h"
+#include "DirCache.h"
+#include "EventWaiter.h"
+#include "AdbAsync.h"
+#include "FastScan.h"
+
+#include <string.h>
 #include <chrono>
+#include <functional>
 #include <vector>
 
-#pragma comment(lib, "Shcore.lib")
-
 using namespace std;
 using namespace chrono;
 
@@ -54,36 +62,144 @@ struct CtrlLocator
 	static CtrlLocator by_rc(const QString& name) { return CtrlLocator("", "", name); }
 };
 
+// 原始输出中的一段字节，只引用不拷贝，需要显示时再转换成QString
+struct ByteView
+{
+    const char *p = nullptr;
+    int n = 0;
+
+    ByteView() {}
+    ByteView(const char *p, int n): p(p), n(n) {}
+
+    int size() const { return n; }
+    bool isEmpty() const { return n == 0; }
+    char operator[](int i) const { return p[i]; }
+    const char *begin() const { return p; }
+    const char *end() const { return p + n; }
+
+    bool startsWith(char c) const { return n > 0 && p[0] == c; }
+
+    bool operator==(const char *s) const
+    {
+        int len = int(strlen(s));
+        return len == n && memcmp(p, s, n) == 0;
+    }
+
+    bool operator!=(const char *s) const { return !(*this == s); }
+
+    bool operator==(const ByteView& o) const { return n == o.n && memcmp(p, o.p, n) == 0; }
+    bool operator!=(const ByteView& o) const { return !(*this == o); }
+
+    int indexOf(char c, int from = 0) const
+    {
+        for (int i = from; i < n; ++i)
+            if (p[i] == c) return i;
+        return -1;
+    }
+
+    int lastIndexOf(char c) const
+    {
+        for (int i = n - 1; i >= 0; --i)
+            if (p[i] == c) return i;
+        return -1;
+    }
+
+    ByteView mid(int pos, int len = -1) const
+    {
+        pos = qBound(0, pos, n);
+        return ByteView(p + pos, len < 0 ? n - pos : qMin(len, n - pos));
+    }
+
+    // 整数解析，不分配内存
+    qlonglong toLongLong(bool *ok = nullptr, int base = 10) const
+    {
+        qlonglong v = 0;
+        int i = 0;
+        bool neg = n > 0 && p[0] == '-';
+        if (neg) ++i;
+        bool valid = i < n;
+        for (; i < n; ++i)
+        {
+            int d = digit(p[i]);
+            if (d < 0 || d >= base) { valid = false; break; }
+            v = v * base + d;
+        }
+        if (ok) *ok = valid;
+        return valid ? (neg ? -v : v) : 0;
+    }
+
+    qulonglong toULongLong(bool *ok = nullptr, int base = 10) const
+    {
+        qulonglong v = 0;
+        bool valid = n > 0;
+        for (int i = 0; i < n; ++i)
+        {
+            int d = digit(p[i]);
+            if (d < 0 || d >= base) { valid = false; break; }
+            v = v * base + d;
+        }
+        if (ok) *ok = valid;
+        return valid ? v : 0;
+    }
+
+    int toInt(bool *ok = nullptr, int base = 10) const { return int(toLongLong(ok, base)); }
+
+    QString toString() const { return QString::fromUtf8(p, n); }
+    QByteArray toByteArray() const { return QByteArray(p, n); }
+
+    static bool isSpace(char c) { return FastScan::isSpace(c); }
+
+private:
+    static int digit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+        return -1;
+    }
+};
+
 struct ShellResult: public QByteArray
 {
-    ShellResult(QByteArray&& data): QByteArray(data) {}
+    ShellResult(): exitCode(-1), ok(false) {}
+    ShellResult(QByteArray&& data, int code = 0, bool ok = true): QByteArray(data), exitCode(code), ok(ok) {}
+
+    int exitCode;   // 命令退出码，-1表示未能取得(如设备不支持shell v2)
+    bool ok;        // 命令是否执行完毕，连接失败或中断时为false
+
+    // 命令执行完毕，且退出码为0或无从得知
+    bool succeeded() const { return ok && exitCode <= 0; }
 
     // 所有输出转换成字符串
-    inline operator QString()
+    inline operator QString() const
     {
         return QString::fromUtf8(*this);
     }
 
+    // 按行遍历，兼容 \n 和 \r\n 两种换行
     struct iter
     {
         const QByteArray *arr;
-        int next_b = 0;
-        int next_e;
+        int b, e;   // 当前行 [b, e)，不含换行符
+        int next;   // 下一行起始位置
 
-        iter(const ShellResult *a, int size) : arr(a)
-        {
-            next_b = next_e = size;
-        }
+        iter(const ShellResult *a, int pos): arr(a) { seek(pos); }
 
-        iter(const ShellResult *a): arr(a)
+        void seek(int pos)
         {
-            next_e = arr->indexOf("\r\n", next_b);
+            b = e = next = pos;
+            if (b >= arr->size()) return;
+
+            int nl = arr->indexOf('\n', b);
+            if (nl < 0) nl = next = arr->size();
+            else next = nl + 1;
+            e = nl;
+            if (e > b && arr->at(e - 1) == '\r') --e;
         }
 
         iter& operator++()
         {
-            next_b = next_e + 2;
-            next_e = arr->indexOf("\r\n", next_b);
+            seek(next);
             return *this;
         }
 
@@ -97,12 +213,12 @@ struct ShellResult: public QByteArray
 
         QString operator*() const
         {
-            return QString::fromUtf8(arr->data() + next_b, next_e - next_b);
+            return QString::fromUtf8(arr->constData() + b, e - b);
         }
 
         bool operator==(const iter &arg) const
         {
-            return next_b == arg.next_b || next_e < 0;
+            return b == arg.b;
         }
 
         bool operator!=(const iter &arg) const
@@ -111,14 +227,51 @@ struct ShellResult: public QByteArray
         }
     };
 
-    iter begin() const { return iter(this); }
+    iter begin() const { return iter(this, 0); }
     iter end() const { return iter(this, this->size()); }
 
-    QStringList split()
+    // 按行遍历，每行为指向原始数据的ByteView
+    struct view_iter: public iter
+    {
+        view_iter(const ShellResult *a, int pos): iter(a, pos) {}
+
+        ByteView operator*() const { return ByteView(arr->constData() + b, e - b); }
+
+        view_iter& operator++()
+        {
+            iter::operator++();
+            return *this;
+        }
+    };
+
+    struct Lines
+    {
+        const ShellResult *r;
+
+        view_iter begin() const { return view_iter(r, 0); }
+        view_iter end() const { return view_iter(r, r->size()); }
+    };
+
+    Lines lines() const { return Lines{ this }; }
+
+    // 一次向量化扫描切分出所有行，适合行数很多的大输出
+    QVector<ByteView> lineViews() const
     {
-        auto l = ((QString)(*this)).split("\r\n");
-		if (l.size() > 0 && l.last().size() == 0)
-			l.pop_back();		// 去除最后的空行
+        QVector<ByteView> l;
+        auto p = constData();
+        int b = 0;
+        FastScan::forEachNewline(p, size(), [&](int nl) {
+            l.push_back(ByteView(p + b, nl > b && p[nl - 1] == '\r' ? nl - 1 - b : nl - b));
+            b = nl + 1;
+        });
+        if (b < size()) l.push_back(ByteView(p + b, size() - b));
+        return l;
+    }
+
+    QStringList split() const
+    {
+        QStringList l;
+        for (auto line : *this) l.push_back(line);
         return l;
     }
 };
@@ -167,33 +320,167 @@ private:
     int cur_pos = 0;
 };
 
+// 按空白分隔读取一行中的字段，与LineParser相同，但直接在原始字节上切分
+struct LineView
+{
+    LineView(const ByteView& line): s(line) {}
+
+    // 一串连续的非空格字符串
+    ByteView next()
+    {
+        skip_white();
+        auto pos = cur_pos;
+        cur_pos = FastScan::findSpace(s.p, cur_pos, s.n);
+        return s.mid(pos, cur_pos - pos);
+    }
+
+    // 剩余部分一次切分成最多max个字段，最后一个字段包含行尾所有内容，返回字段数
+    int split(ByteView *out, int max)
+    {
+        int count = 0;
+        FastScan::forEachField(s.p + cur_pos, s.n - cur_pos, [&](int b, int e) {
+            if (count == max - 1)
+            {
+                out[count++] = s.mid(cur_pos + b);
+                return false;
+            }
+            out[count++] = s.mid(cur_pos + b, e - b);
+            return true;
+        });
+        cur_pos = s.n;
+        return count;
+    }
+
+    ByteView readTo(char c)
+    {
+        skip_white();
+        auto pos = cur_pos;
+        while (cur_pos < s.n && s.p[cur_pos] != c) ++cur_pos;
+        if (cur_pos < s.n) ++cur_pos;
+        return s.mid(pos, cur_pos - pos);
+    }
+
+    ByteView psname()
+    {
+        skip_white();
+        return cur_pos < s.n && s.p[cur_pos] == '[' ? readTo(']') : next();
+    }
+
+    ByteView rest(bool skip = true)
+    {
+        if (skip) skip_white();
+        return s.mid(cur_pos);
+    }
+
+    void skip_white()
+    {
+        cur_pos = FastScan::skipSpace(s.p, cur_pos, s.n);
+    }
+
+    bool atEnd() const { return cur_pos >= s.n; }
+
+private:
+    ByteView s;
+    int cur_pos = 0;
+};
+
+class InputInjector;
+
 // 模拟器
 class AdbDevice
 {
 public:
-	// 执行adb命令，并返回输出结果(二进制)
-	static ShellResult adb(const QStringList& args)
-	{
-        QProcess p;
-        p.start("adb.exe", args);
-		p.waitForFinished();
-		return p.readAll();
-	}
+    QStringList adb_shell(const QStringList& args)
+    {
+        return shell(args).split();
+    }
 
-    static QStringList adb_l(const QStringList& args)
+    // 通过adb server直接执行shell命令，省去adb.exe进程的启动开销
+    ShellResult shell(const QStringList& args, bool root = false)
     {
-		return adb(args).split();
+        return shellBatch({ args.join(' ') }, root).takeFirst();
     }
 
-    QStringList adb_shell(const QStringList& args)
+    // 在常驻shell会话中一次执行多条命令，按顺序返回各自的输出和退出码
+    QList<ShellResult> shellBatch(const QStringList& cmds, bool root = false)
     {
-        return adb_l(QStringList{"-s", name, "shell"} + args);
+        QList<QByteArray> list;
+        for (auto& c : cmds)
+            list.push_back((root ? "su -c " + c : c).toUtf8());
+
+        QList<ShellResult> results;
+        if (shellV2())
+        {
+            for (auto& r : session.exec(list))
+                results.push_back(ShellResult(std::move(r.out), r.code, r.code >= 0));
+        }
+        // 会话不可用或中途断开时，剩下的命令逐条执行
+        while (results.size() < list.size())
+        {
+            int code = -1;
+            bool ok;
+            auto out = AdbClient::shell(name, list[results.size()], shellV2(), &code, nullptr, &ok);
+            results.push_back(ShellResult(std::move(out), code, ok));
+        }
+        return results;
     }
 
-    ShellResult shell(const QStringList& args, bool root = false)
+    // 作为一个shell参数，用单引号括起
+    static QString quote(QString s)
     {
-        return root ? adb(QStringList{"-s", name, "shell", "su", "-c"} + args)
-                    : adb(QStringList{"-s", name, "shell"} + args);
+        return "'" + s.replace("'", "'\\''") + "'";
+    }
+
+    // 是否支持shell v2协议
+    bool shellV2() { return hasFeature("shell_v2"); }
+
+    // 设备特性，如 shell_v2、ls_v2、stat_v2，查询成功后缓存，失败时下次重新查询
+    bool hasFeature(const QString& f)
+    {
+        QMutexLocker lock(&featureLock);
+        if (!featuresLoaded)
+        {
+            QString err;
+            auto list = AdbClient::features(name, &err);
+            if (!err.isEmpty()) return false;
+            features = list;
+            featuresLoaded = true;
+        }
+        return features.contains(f);
+    }
+
+    // 通过sync服务列目录，结果存入DirCache，refresh为true或缓存过期时重新读取
+    // 符号链接会补上目标路径和是否指向目录
+    QVector<AdbSync::Entry> listDir(const QString& dir, bool refresh = false, QString *err = nullptr)
+    {
+        QVector<AdbSync::Entry> list;
+        if (!refresh && DirCache::instance().get(name, dir, list)) return list;
+
+        AdbSync sync(name, hasFeature("ls_v2") && hasFeature("stat_v2"));
+        return readDir(sync, dir, err);
+    }
+
+    // 只取缓存，返回是否仍在有效期内，过期的内容也会放入out
+    bool cachedDir(const QString& dir, QVector<AdbSync::Entry>& out)
+    {
+        return DirCache::instance().get(name, dir, out);
+    }
+
+    // 预读目录，共用一条sync连接；再次调用时之前未完成的预读停止
+    void prefetchDirs(const QStringList& dirs, int gen)
+    {
+        AdbSync sync(name, hasFeature("ls_v2") && hasFeature("stat_v2"));
+        for (auto& dir : dirs)
+        {
+            if (prefetchGen.loadAcquire() != gen) return;
+            if (!DirCache::instance().contains(name, dir)) readDir(sync, dir);
+        }
+    }
+
+    // 目录内容有变化(如上传、删除文件)后调用
+    void invalidateDir(const QString& dir, bool recursive = false)
+    {
+        DirCache::instance().invalidate(name, dir, recursive);
     }
 
     // 设备型号
@@ -205,17 +492,16 @@ public:
     // 设备列表
     static QList<QString> devices()
     {
-        auto l = adb_l(QStringList{ "devices" });
         QList<QString> result;
-        for (int i = 1; i < l.size(); ++i)
+        for (auto line : ShellResult(AdbClient::query("host:devices")))
         {
-            auto sl = l[i].split(QRegExp("\\s+"));
+            auto sl = line.split(QRegExp("\\s+"));
             if (sl.size() > 1) result.push_back(sl[0]);
         }
         return result;
     }
 
-    AdbDevice(const QString& name): name(name) {}
+    AdbDevice(const QString& name): name(name), session(name) {}
 
 	// 输入文字
 	void input(const QString& text)
@@ -232,16 +518,14 @@ public:
 	};
 
 	// 点击屏幕
-	void tap(const EmuPoint& p)
-	{
-        adb_shell(QStringList{
-            "input", "tap",
-            QString::number(p.x), QString::number(p.y),
-        });
-	}
+	// 经设备共用的InputInjector直接写触摸屏，不能写时退回 input tap
+	bool tap(const EmuPoint& p);
+
+	// 在设备共用的InputInjector上执行一组输入操作，写触摸屏的连接只有一条，多个线程的调用依次进行
+	bool inject(const std::function<void(InputInjector&)>& build, const CancelToken& token = CancelToken());
 
 	// 点击屏幕
-	inline void tap(int x, int y) { tap(EmuPoint { x, y }); }
+	inline bool tap(int x, int y) { return tap(EmuPoint { x, y }); }
 
 	// 控件边界
 	struct CtrlBound
@@ -256,105 +540,156 @@ public:
 	};
 
 	// 点击屏幕
-	inline void tap(const CtrlBound& b) { tap(b.center()); }
+	inline bool tap(const CtrlBound& b) { return tap(b.center()); }
 
 	// 寻找控件位置
 	CtrlBound find_ctrl(const CtrlLocator& l)
 	{
 		CtrlBound bound;
+		dump_ui([&](const QXmlStreamAttributes& attr) {
+			// ResouceID 单独定位
+			if (l.rc.size() > 0)
+			{
+				if (attr.value("resource-id") != l.rc) return false;
+			}
+			else
+			{
+				// 结合class和text定位
+				if (l.cls.size() > 0 && attr.value("class") != l.cls) return false;
+				if (attr.value("text") != l.text) return false;
+			}
+			bound = parse_bounds(attr.value("bounds"));
+			return true;
+		});
+		return bound;
+	}
+
+	// "[left,top][right,bottom]"
+	static CtrlBound parse_bounds(const QStringRef& s)
+	{
+		CtrlBound b;
+		int v[4] = { 0, 0, 0, 0 };
+		int n = -1;
+		for (auto c : s)
+		{
+			if (c.isDigit() && n >= 0 && n < 4) v[n] = v[n] * 10 + c.digitValue();
+			else if (c == '[' || c == ',') ++n;
+		}
+		if (n != 3) return b;
+		b.left = v[0], b.top = v[1], b.right = v[2], b.bottom = v[3];
+		return b;
+	}
 
-  //      QRegExp reg(R"(to:\s*(\S+)$)");
-		//auto s = adb_shell(QStringList {"uiautomator", "dump", "--compressed"});
-  //      if (!(s.size() && s[0].indexOf(reg) > 0))
-  //          return bound;
+	// 抓取界面层次，对每个node调用visit，visit返回true时停止；leave在node结束时调用
+	// 默认让uiautomator直接写到标准输出，边接收边解析，不经过/sdcard上的文件；
+	// 连续几次拿不到输出时认为设备不支持，之后改用临时文件
+	bool dump_ui(const std::function<bool(const QXmlStreamAttributes&)>& visit, const std::function<void()>& leave = nullptr)
+	{
+		if (uiDumpFails.loadAcquire() < 3)
+		{
+			bool found = false;
+			if (dump_ui_stream(visit, leave, found))
+			{
+				uiDumpFails.storeRelease(0);
+				return found;
+			}
+			// 偶尔失败(如界面未空闲)由调用者重试
+			if (uiDumpFails.fetchAndAddOrdered(1) + 1 < 3) return false;
+		}
 
-  //      auto xml_path = reg.cap(1);
-  //      qDebug() << "xml path: " << xml_path;
+		auto data = shell({ "f=/data/local/tmp/.qtadb_ui.xml;",
+			"uiautomator", "dump", "--compressed", "$f", ">/dev/null", "&&", "cat", "$f;", "rm", "-f", "$f" });
+		QXmlStreamReader xml(data);
+		bool found = false;
+		parse_ui(xml, visit, leave, found);
+		return found;
+	}
 
-        auto xml_path = "/sdcard/window_dump.xml";
 
-		adb_shell(QStringList {"uiautomator", "dump", "--compressed"});
-		auto data = adb_shell(QStringList {"cat", xml_path, ";", "rm", xml_path});
-        if (data.isEmpty()) return bound;
+private:
+	// 解析已收到的部分，返回是否已结束(找到或文档结束)
+	static bool parse_ui(QXmlStreamReader& xml, const std::function<bool(const QXmlStreamAttributes&)>& visit,
+		const std::function<void()>& leave, bool& found)
+	{
+		while (!xml.atEnd())
+		{
+			auto token = xml.readNext();
+			if (token == QXmlStreamReader::StartElement && xml.name() == "node" && visit(xml.attributes()))
+				return found = true;
+			if (token == QXmlStreamReader::EndElement && xml.name() == "node" && leave)
+				leave();
+			if (token == QXmlStreamReader::EndElement && xml.name() == "hierarchy")
+				return true;
+		}
+		return xml.error() != QXmlStreamReader::PrematureEndOfDocumentError;
+	}
 
-		QString result;
-		QXmlStreamReader xml(data[0]);
-		while (!xml.atEnd() && !xml.hasError())
+	// 返回是否拿到了XML
+	bool dump_ui_stream(const std::function<bool(const QXmlStreamAttributes&)>& visit,
+		const std::function<void()>& leave, bool& found)
+	{
+		AdbSocket s;
+		if (!AdbClient::open(s, name, "exec:uiautomator dump --compressed /proc/self/fd/1")) return false;
+
+		QXmlStreamReader xml;
+		QByteArray head;        // XML开始之前可能有提示信息
+		bool started = false;
+		char buf[64 * 1024];
+		for (int r; (r = s.read(buf, sizeof(buf))) > 0; )
 		{
-			//读取下一个element.
-			QXmlStreamReader::TokenType token = xml.readNext();
-			//如果获取了StartElement,则尝试读取
-			if (token == QXmlStreamReader::StartElement && xml.name() == "node")
+			if (!started)
 			{
-				QXmlStreamAttributes attr = xml.attributes();
-
-				// ResouceID 单独定位
-				if (l.rc.size() > 0)
-				{
-					if (attr.value("resource-id").toString() == l.rc)
-					{
-						result = attr.value("bounds").toString(); break;
-					}
-					else continue;
-				}
-
-				// 结合class和text定位
-				if (l.cls.size() > 0)
-				{
-					if (attr.value("class").toString() != l.cls) continue;
-				}
-				if (attr.value("text").toString() == l.text)
-				{
-					result = attr.value("bounds").toString(); break;
-				}
+				head.append(buf, r);
+				int i = head.indexOf("<?xml");
+				if (i < 0) continue;
+				started = true;
+				xml.addData(head.mid(i));
 			}
-		}
+			else xml.addData(QByteArray::fromRawData(buf, r));
 
-		if (result.size() > 0)
-		{
-			QRegExp reg(R"(\[(\d+),(\d+)\]\[(\d+),(\d+)\])");
-			auto pos = result.indexOf(reg);	// TODO: assert(pos >= 0)
-			bound.left = reg.cap(1).toInt();
-			bound.top = reg.cap(2).toInt();
-			bound.right = reg.cap(3).toInt();
-			bound.bottom = reg.cap(4).toInt();
+			// 找到后直接断开，剩余部分不再接收
+			if (parse_ui(xml, visit, leave, found)) return true;
 		}
-		return bound;
+		return started;
 	}
 
-	// 等待某个控件出现在当前页面
-	CtrlBound wait_ctrl(const CtrlLocator& l, int ms = 100 * 1000)
+public:
+	// 等待某个控件出现在当前页面，token被取消时提前返回
+	// activity切换时立即重新查找，其余时候按退避间隔查找
+	CtrlBound wait_ctrl(const CtrlLocator& l, int ms = 100 * 1000, const CancelToken& token = CancelToken())
 	{
-		auto t = system_clock::now();
+		QElapsedTimer t;
+		t.start();
+		EventWaiter waiter(name);
 		CtrlBound bound;
 		do {
 			if (bound = find_ctrl(l)) break;
-		} while (duration_cast<milliseconds>(system_clock::now() - t).count() < ms);
+		} while (waiter.wait(ms - t.elapsed(), token));
 		return bound;
 	}
 
 	// 寻找控件位置
-	CtrlBound click_ctrl(const QString& text, int ms = 100 * 1000)
+	CtrlBound click_ctrl(const QString& text, int ms = 100 * 1000, const CancelToken& token = CancelToken())
 	{
-		auto t = system_clock::now();
-		auto bound = wait_ctrl(text, ms);
+		auto bound = wait_ctrl(text, ms, token);
 		if (bound) { tap(bound.center()); }
 		return bound;
 	}
 
 	// 寻找控件位置
-	CtrlBound click_rc(const QString& rc, int ms = 100 * 1000)
+	CtrlBound click_rc(const QString& rc, int ms = 100 * 1000, const CancelToken& token = CancelToken())
 	{
-		auto bound = wait_ctrl(CtrlLocator::by_rc(rc), ms);
+		auto bound = wait_ctrl(CtrlLocator::by_rc(rc), ms, token);
 		if (bound) tap(bound.center());
 		return bound;
 	}
 
-	// 启动应用
+	// 启动应用，am在找不到Activity时退出码可能仍为0，需再看输出
 	// com.ss.android.ugc.live/com.ss.android.ugc.live.main.MainActivity
-	void start_app(const QString& pkg_act)
+	bool start_app(const QString& pkg_act)
 	{
-		adb_shell(QStringList {"am", "start", "-n", pkg_act});
+		auto r = shell(QStringList {"am", "start", "-n", pkg_act});
+		return r.succeeded() && !r.contains("Error");
 	}
 
 	// 获取当前Activity
@@ -377,13 +712,15 @@ public:
 		return result;
 	}
 
-	bool wait_activity(const QString& name, int timeout = 100 * 1000)
+	// 等待切换到指定的activity，只在收到切换事件时才查询，空闲时几乎没有开销
+	bool wait_activity(const QString& name, int timeout = 100 * 1000, const CancelToken& token = CancelToken())
 	{
-		auto t = system_clock::now();
+		QElapsedTimer t;
+		t.start();
+		EventWaiter waiter(this->name, EventWaiter::activityTags(), 5000);
 		do {
 			if (activity() == name) return true;
-			Sleep(100);
-		} while (duration_cast<milliseconds>(system_clock::now() - t).count() < timeout);
+		} while (waiter.wait(timeout - t.elapsed(), token));
 		return false;
 	}
 
@@ -393,7 +730,130 @@ public:
 		return adb_shell(QStringList {"dumpsys", "window", "|", "grep", name}).size() > 0;
 	}
 
+	// 异步接口: 在后台线程池中执行，用 Async::then() 在界面线程取结果
+	// 等待类操作可通过 CancelToken 取消或设置超时
+
+	static QFuture<QList<QString>> devicesAsync()
+	{
+		return Async::run([] { return devices(); });
+	}
+
+	QFuture<QString> modelAsync()
+	{
+		return Async::run([this] { return model(); });
+	}
+
+	QFuture<ShellResult> shellAsync(const QStringList& args, bool root = false)
+	{
+		return Async::run([=] { return shell(args, root); });
+	}
+
+	QFuture<QList<ShellResult>> shellBatchAsync(const QStringList& cmds, bool root = false)
+	{
+		return Async::run([=] { return shellBatch(cmds, root); });
+	}
+
+	QFuture<QVector<AdbSync::Entry>> listDirAsync(const QString& dir, bool refresh = false)
+	{
+		return Async::run([=] { return listDir(dir, refresh); });
+	}
+
+	QFuture<void> prefetchDirsAsync(const QStringList& dirs)
+	{
+		int gen = prefetchGen.fetchAndAddOrdered(1) + 1;
+		return Async::run([=] { prefetchDirs(dirs, gen); });
+	}
+
+	QFuture<void> tapAsync(int x, int y)
+	{
+		return Async::run([=] { tap(x, y); });
+	}
+
+	QFuture<CtrlBound> findCtrlAsync(const CtrlLocator& l)
+	{
+		return Async::run([=] { return find_ctrl(l); });
+	}
+
+	QFuture<CtrlBound> waitCtrlAsync(const CtrlLocator& l, int ms = 100 * 1000, const CancelToken& token = CancelToken())
+	{
+		return Async::run([=] { return wait_ctrl(l, ms, token); });
+	}
+
+	QFuture<CtrlBound> clickCtrlAsync(const QString& text, int ms = 100 * 1000, const CancelToken& token = CancelToken())
+	{
+		return Async::run([=] { return click_ctrl(text, ms, token); });
+	}
+
+	QFuture<CtrlBound> clickRcAsync(const QString& rc, int ms = 100 * 1000, const CancelToken& token = CancelToken())
+	{
+		return Async::run([=] { return click_rc(rc, ms, token); });
+	}
+
+	QFuture<void> startAppAsync(const QString& pkg_act)
+	{
+		return Async::run([=] { start_app(pkg_act); });
+	}
+
+	QFuture<QString> activityAsync()
+	{
+		return Async::run([this] { return activity(); });
+	}
+
+	QFuture<bool> waitActivityAsync(const QString& name, int timeout = 100 * 1000, const CancelToken& token = CancelToken())
+	{
+		return Async::run([=] { return wait_activity(name, timeout, token); });
+	}
+
+	QFuture<bool> appActiveAsync(const QString& name)
+	{
+		return Async::run([=] { return app_active(name); });
+	}
+
 	QString name;		// 设备名称
+
+private:
+    QMutex featureLock;
+    QStringList features;
+    bool featuresLoaded = false;
+    ShellSession session;   // 常驻shell会话
+    QMutex injectLock;
+    QScopedPointer<InputInjector> injector;    // 首次点击时创建
+    QAtomicInt prefetchGen; // 预读批次
+    QAtomicInt uiDumpFails;     // 界面层次直接输出到标准输出连续失败的次数
+
+    QVector<AdbSync::Entry> readDir(AdbSync& sync, const QString& dir, QString *err = nullptr)
+    {
+        QVector<AdbSync::Entry> list;
+        if (!sync.list(dir, list, err)) return list;
+
+        auto base = dir.endsWith('/') ? dir : dir + '/';
+        QStringList links;
+        QVector<int> idx;
+        for (int i = 0; i < list.size(); ++i)
+        {
+            if (!list[i].isLink()) continue;
+            links.push_back(base + list[i].name);
+            idx.push_back(i);
+        }
+        if (links.size())
+        {
+            // 链接是否指向目录由stat判断，目标路径sync协议不提供，在常驻会话中批量readlink
+            QVector<AdbSync::Entry> targets;
+            if (sync.stat(links, targets, true))
+                for (int i = 0; i < idx.size(); ++i) list[idx[i]].linkDir = targets[i].isDir();
+
+            QStringList cmds;
+            for (auto& l : links) cmds.push_back("readlink " + quote(l));
+            auto r = shellBatch(cmds);
+            for (int i = 0; i < idx.size(); ++i) list[idx[i]].link = QString(r[i]).trimmed();
+        }
+
+        DirCache::instance().put(name, dir, list);
+        return list;
+    }
 };
 
+// tap()、inject() 的实现在其中，须在AdbDevice之后
+#include "InputInjector.h"
+
 #endif // __ADBDEVICE_H__
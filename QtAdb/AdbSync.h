@@ -0,0 +1,325 @@
+#pragma once
+
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QIODevice>
+#include <functional>
+
+#include "AdbClient.h"
+
+// adb sync 服务(sync:)，用二进制协议列目录、查询文件属性，不经过shell
+//  请求: 4字节命令 + 4字节小端长度 + 路径
+//  应答: 命令对应的定长结构(+文件名)，出错时为 "FAIL" + 4字节小端长度 + 信息
+// 设备支持 ls_v2/stat_v2 时使用 LIS2/STA2/LST2，可拿到64位大小和uid/gid
+// 每个对象独占一条连接，不同线程各自创建即可并发
+class AdbSync
+{
+public:
+    struct Entry
+    {
+        QString name;
+        QString link;           // 符号链接的目标，需另外读取
+        quint32 mode = 0;
+        quint32 uid = 0;
+        quint32 gid = 0;
+        quint64 size = 0;
+        qint64 mtime = 0;       // 秒
+        bool hasOwner = false;  // v1协议没有uid/gid
+        bool linkDir = false;   // 符号链接指向目录
+
+        bool exists() const { return mode != 0; }
+        bool isDir() const { return (mode & 0170000) == 0040000; }
+        bool isLink() const { return (mode & 0170000) == 0120000; }
+        bool isFile() const { return (mode & 0170000) == 0100000; }
+
+        // 与ls相同格式的权限，如 drwxr-xr-x
+        QString perms() const
+        {
+            static const char types[] = "?pc?d?b?-?l?s???";
+            QString s(10, '-');
+            s[0] = types[(mode >> 12) & 15];
+            const char *rwx = "rwx";
+            for (int i = 0; i < 9; ++i)
+                if (mode & (0400 >> i)) s[i + 1] = rwx[i % 3];
+            if (mode & 04000) s[3] = s[3] == 'x' ? 's' : 'S';
+            if (mode & 02000) s[6] = s[6] == 'x' ? 's' : 'S';
+            if (mode & 01000) s[9] = s[9] == 'x' ? 't' : 'T';
+            return s;
+        }
+    };
+
+    // Android固定的uid/gid名称，应用为 u<用户>_a<序号>
+    static QString idName(quint32 id)
+    {
+        static const QHash<quint32, QString> names = {
+            { 0, "root" }, { 1000, "system" }, { 1001, "radio" }, { 1002, "bluetooth" },
+            { 1003, "graphics" }, { 1004, "input" }, { 1005, "audio" }, { 1006, "camera" },
+            { 1007, "log" }, { 1010, "wifi" }, { 1013, "media" }, { 1015, "sdcard_rw" },
+            { 1023, "media_rw" }, { 1028, "sdcard_r" }, { 1032, "package_info" },
+            { 1078, "ext_data_rw" }, { 1079, "ext_obb_rw" }, { 2000, "shell" }, { 2001, "cache" },
+            { 3003, "inet" }, { 3009, "readproc" }, { 9997, "everybody" }, { 9998, "misc" }, { 9999, "nobody" },
+        };
+        quint32 user = id / 100000, app = id % 100000;
+        if (app >= 99000) return QString("u%1_i%2").arg(user).arg(app - 99000);
+        if (app >= 10000) return QString("u%1_a%2").arg(user).arg(app - 10000);
+        auto it = names.constFind(app);
+        if (it == names.cend()) return QString::number(id);
+        return user ? QString("u%1_%2").arg(user).arg(*it) : *it;
+    }
+
+    AdbSync(const QString& serial, bool v2): serial(serial), v2(v2) {}
+
+    ~AdbSync() { close(); }
+
+    bool open(QString *err = nullptr)
+    {
+        if (sock.isOpen()) return true;
+        return AdbClient::open(sock, serial, "sync:", err);
+    }
+
+    void close()
+    {
+        if (!sock.isOpen()) return;
+        while (acks > 0 && readAck()) {}
+        send("QUIT", QByteArray());
+        sock.close();
+    }
+
+    // 列出目录内容，不含 . 和 ..
+    bool list(const QString& dir, QVector<Entry>& out, QString *err = nullptr)
+    {
+        if (!open(err)) return false;
+        if (!send(v2 ? "LIS2" : "LIST", dir.toUtf8())) return broken(err);
+
+        for (;;)
+        {
+            char id[4];
+            if (!sock.readFully(id, 4)) return broken(err);
+            if (memcmp(id, "FAIL", 4) == 0) return readFail(err);
+
+            Entry e;
+            quint32 len = 0;
+            if (v2)
+            {
+                char b[DentV2];
+                if (!sock.readFully(b, sizeof(b))) return broken(err);
+                parseV2(b, e);
+                len = qFromLittleEndian<quint32>(b + 68);
+            }
+            else
+            {
+                char b[DentV1];
+                if (!sock.readFully(b, sizeof(b))) return broken(err);
+                parseV1(b, e);
+                len = qFromLittleEndian<quint32>(b + 12);
+            }
+            if (memcmp(id, "DONE", 4) == 0) return true;
+
+            QByteArray name(int(len), Qt::Uninitialized);
+            if (!sock.readFully(name.data(), name.size())) return broken(err);
+            if (name == "." || name == "..") continue;
+            e.name = QString::fromUtf8(name);
+            out.push_back(e);
+        }
+    }
+
+    // 查询文件属性，follow为true时跟随符号链接
+    bool stat(const QString& path, Entry& e, bool follow = true, QString *err = nullptr)
+    {
+        QVector<Entry> out;
+        if (!stat(QStringList{ path }, out, follow, err)) return false;
+        e = out[0];
+        return e.exists();
+    }
+
+    // 批量查询，请求一次发出再依次读取应答，省去逐个往返的等待
+    // 不存在的文件mode为0
+    bool stat(const QStringList& paths, QVector<Entry>& out, bool follow = true, QString *err = nullptr)
+    {
+        if (!open(err)) return false;
+
+        QByteArray req;
+        for (auto& path : paths)
+        {
+            auto p = path.toUtf8();
+            // v1的STAT不跟随链接，路径末尾加'/'让内核解析链接，此时只能查到目录
+            if (!v2 && follow && !p.endsWith('/')) p += '/';
+            req += packet(v2 ? (follow ? "STA2" : "LST2") : "STAT", p);
+        }
+        if (!sock.write(req)) return broken(err);
+
+        for (auto& path : paths)
+        {
+            char id[4];
+            if (!sock.readFully(id, 4)) return broken(err);
+            if (memcmp(id, "FAIL", 4) == 0) return readFail(err);
+
+            Entry e;
+            e.name = path.mid(path.lastIndexOf('/') + 1);
+            if (v2)
+            {
+                char b[StatV2];
+                if (!sock.readFully(b, sizeof(b))) return broken(err);
+                parseV2(b, e);
+                if (qFromLittleEndian<quint32>(b)) e.mode = 0;  // errno
+            }
+            else
+            {
+                char b[StatV1];
+                if (!sock.readFully(b, sizeof(b))) return broken(err);
+                parseV1(b, e);
+            }
+            out.push_back(e);
+        }
+        return true;
+    }
+
+    // 单个DATA包的最大长度
+    enum { MaxChunk = 64 * 1024 };
+
+    // 上传: SEND "路径,权限" + 若干DATA + DONE 修改时间
+    // 不等待应答，多个文件可以连续发送，之后用readAck按顺序取回结果
+    // progress参数为本次写入的字节数，返回false时中止
+    bool sendFile(const QString& remote, quint32 mode, qint64 mtime, QIODevice& in,
+                  const std::function<bool(int)>& progress = nullptr, QString *err = nullptr)
+    {
+        if (!open(err)) return false;
+        sock.setBufferSize(1024 * 1024);
+        if (!send("SEND", remote.toUtf8() + ',' + QByteArray::number(mode & 0777))) return broken(err);
+
+        // 包头和数据一次写出
+        chunk.resize(8 + MaxChunk);
+        for (;;)
+        {
+            auto n = in.read(chunk.data() + 8, MaxChunk);
+            if (n < 0) return broken(err, "read local file failed");
+            if (n == 0) break;
+            memcpy(chunk.data(), "DATA", 4);
+            qToLittleEndian<quint32>(quint32(n), chunk.data() + 4);
+            if (!sock.write(chunk.constData(), int(8 + n))) return broken(err);
+            if (progress && !progress(int(n))) return broken(err, "cancelled");
+        }
+
+        char done[8];
+        memcpy(done, "DONE", 4);
+        qToLittleEndian<quint32>(quint32(mtime), done + 4);
+        if (!sock.write(done, 8)) return broken(err);
+        ++acks;
+        return true;
+    }
+
+    // 尚未取回应答的上传数
+    int pendingAcks() const { return acks; }
+
+    // 取回最早一个上传的结果，失败后服务端会关闭连接，之后的上传都需要重发
+    bool readAck(QString *err = nullptr)
+    {
+        char id[8];
+        --acks;
+        if (!sock.readFully(id, 8)) return broken(err);
+        if (memcmp(id, "OKAY", 4) == 0) return true;
+        if (memcmp(id, "FAIL", 4) == 0)
+        {
+            QByteArray msg(int(qFromLittleEndian<quint32>(id + 4)), Qt::Uninitialized);
+            if (!sock.readFully(msg.data(), msg.size())) msg.clear();
+            sock.close();
+            acks = 0;
+            if (err) *err = QString::fromUtf8(msg);
+            return false;
+        }
+        return broken(err);
+    }
+
+    // 下载: RECV 路径，应答为若干DATA，以DONE结束
+    bool recvFile(const QString& remote, QIODevice& out,
+                  const std::function<bool(int)>& progress = nullptr, QString *err = nullptr)
+    {
+        if (!open(err)) return false;
+        sock.setBufferSize(1024 * 1024);
+        if (!send("RECV", remote.toUtf8())) return broken(err);
+
+        chunk.resize(MaxChunk);
+        for (;;)
+        {
+            char hdr[8];
+            if (!sock.readFully(hdr, 8)) return broken(err);
+            quint32 len = qFromLittleEndian<quint32>(hdr + 4);
+            if (memcmp(hdr, "DONE", 4) == 0) return true;
+            if (memcmp(hdr, "FAIL", 4) == 0)
+            {
+                QByteArray msg(int(len), Qt::Uninitialized);
+                if (!sock.readFully(msg.data(), msg.size())) msg.clear();
+                sock.close();
+                if (err) *err = QString::fromUtf8(msg);
+                return false;
+            }
+            if (memcmp(hdr, "DATA", 4) != 0 || len > MaxChunk) return broken(err);
+
+            if (!sock.readFully(chunk.data(), int(len))) return broken(err);
+            if (out.write(chunk.constData(), len) != len) return broken(err, "write local file failed");
+            if (progress && !progress(int(len))) return broken(err, "cancelled");
+        }
+    }
+
+private:
+    // 各应答结构去掉4字节id后的长度
+    enum { DentV1 = 16, StatV1 = 12, StatV2 = 68, DentV2 = 72 };
+
+    static QByteArray packet(const char *id, const QByteArray& data)
+    {
+        char len[4];
+        qToLittleEndian<quint32>(quint32(data.size()), len);
+        return QByteArray(id, 4) + QByteArray(len, 4) + data;
+    }
+
+    bool send(const char *id, const QByteArray& data) { return sock.write(packet(id, data)); }
+
+    // mode(4) size(4) mtime(4)
+    static void parseV1(const char *b, Entry& e)
+    {
+        e.mode = qFromLittleEndian<quint32>(b);
+        e.size = qFromLittleEndian<quint32>(b + 4);
+        e.mtime = qFromLittleEndian<quint32>(b + 8);
+    }
+
+    // error(4) dev(8) ino(8) mode(4) nlink(4) uid(4) gid(4) size(8) atime(8) mtime(8) ctime(8)
+    static void parseV2(const char *b, Entry& e)
+    {
+        e.mode = qFromLittleEndian<quint32>(b + 20);
+        e.uid = qFromLittleEndian<quint32>(b + 28);
+        e.gid = qFromLittleEndian<quint32>(b + 32);
+        e.size = qFromLittleEndian<quint64>(b + 36);
+        e.mtime = qFromLittleEndian<qint64>(b + 52);
+        e.hasOwner = true;
+    }
+
+    bool readFail(QString *err)
+    {
+        char len[4];
+        QByteArray msg;
+        if (sock.readFully(len, 4))
+        {
+            msg.resize(int(qFromLittleEndian<quint32>(len)));
+            if (!sock.readFully(msg.data(), msg.size())) msg.clear();
+        }
+        // FAIL之后服务端关闭连接
+        sock.close();
+        if (err) *err = QString::fromUtf8(msg);
+        return false;
+    }
+
+    bool broken(QString *err, const char *msg = "sync connection broken")
+    {
+        sock.close();
+        acks = 0;
+        if (err) *err = msg;
+        return false;
+    }
+
+    QString serial;
+    bool v2;
+    AdbSocket sock;
+    QByteArray chunk;   // 收发缓冲
+    int acks = 0;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QElapsedTimer>
+
+#include "AdbSync.h"
+
+// 目录内容缓存，键为 设备+路径，所有设备共用一个内存上限
+// 超过有效期的条目仍可取出用于先行显示，但需要重新读取；超过上限时淘汰最久未使用的
+class DirCache
+{
+public:
+    typedef QVector<AdbSync::Entry> List;
+
+    static DirCache& instance()
+    {
+        static DirCache c;
+        return c;
+    }
+
+    // ttl: 有效期(毫秒)，maxBytes: 估算的内存上限
+    void setLimits(int ttl, qint64 maxBytes)
+    {
+        QMutexLocker lock(&mutex);
+        this->ttl = ttl;
+        this->maxBytes = maxBytes;
+        evict();
+    }
+
+    // 取出缓存内容，返回是否仍在有效期内；不存在时out不变
+    bool get(const QString& serial, const QString& dir, List& out)
+    {
+        QMutexLocker lock(&mutex);
+        auto it = items.find(key(serial, dir));
+        if (it == items.end()) return false;
+        touch(it.key(), *it);
+        out = it->list;
+        return clock.elapsed() - it->loaded < ttl;
+    }
+
+    bool contains(const QString& serial, const QString& dir)
+    {
+        QMutexLocker lock(&mutex);
+        auto it = items.constFind(key(serial, dir));
+        return it != items.cend() && clock.elapsed() - it->loaded < ttl;
+    }
+
+    void put(const QString& serial, const QString& dir, const List& list)
+    {
+        QMutexLocker lock(&mutex);
+        auto k = key(serial, dir);
+        auto it = items.find(k);
+        if (it != items.end()) remove(it);
+
+        Item item;
+        item.list = list;
+        item.loaded = clock.elapsed();
+        item.bytes = sizeof(Item) + k.size() * 2;
+        for (auto& e : list) item.bytes += sizeof(e) + (e.name.size() + e.link.size()) * 2;
+        touch(k, items.insert(k, item).value());
+        bytes += item.bytes;
+        evict();
+    }
+
+    // 目录内容有变化(如上传、删除文件)后调用，recursive时包括所有子目录
+    void invalidate(const QString& serial, const QString& dir, bool recursive = false)
+    {
+        QMutexLocker lock(&mutex);
+        auto k = key(serial, dir);
+        auto prefix = k.endsWith('/') ? k : k + '/';
+        for (auto it = items.begin(); it != items.end(); )
+        {
+            if (it.key() == k || (recursive && it.key().startsWith(prefix))) it = remove(it);
+            else ++it;
+        }
+    }
+
+    void invalidateDevice(const QString& serial) { invalidate(serial, "", true); }
+
+private:
+    struct Item
+    {
+        List list;
+        qint64 loaded = 0;      // 读取时间
+        qint64 used = 0;        // 最近使用序号
+        qint64 bytes = 0;
+    };
+
+    DirCache() { clock.start(); }
+
+    // 路径统一不带结尾的'/'，根目录为空
+    static QString key(const QString& serial, QString dir)
+    {
+        while (dir.endsWith('/')) dir.chop(1);
+        return serial + ':' + dir;
+    }
+
+    void touch(const QString& k, Item& item)
+    {
+        lru.remove(item.used);
+        item.used = ++seq;
+        lru.insert(item.used, k);
+    }
+
+    QHash<QString, Item>::iterator remove(QHash<QString, Item>::iterator it)
+    {
+        lru.remove(it->used);
+        bytes -= it->bytes;
+        return items.erase(it);
+    }
+
+    void evict()
+    {
+        while (bytes > maxBytes && !lru.isEmpty())
+        {
+            auto it = items.find(lru.first());
+            if (it == items.end()) lru.erase(lru.begin());
+            else remove(it);
+        }
+    }
+
+    QMutex mutex;
+    QHash<QString, Item> items;
+    QMap<qint64, QString> lru;      // 使用序号 -> 键，最早使用的在前
+    QElapsedTimer clock;
+    qint64 seq = 0;
+    qint64 bytes = 0;
+    int ttl = 5 * 60 * 1000;
+    qint64 maxBytes = 32 * 1024 * 1024;
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+
+#include "AdbClient.h"
+#include "AdbAsync.h"
+
+// 等待设备界面变化的时机，代替固定间隔的轮询
+// 订阅 logcat -b events 中的activity切换事件，事件到达即唤醒，空闲时只是一条阻塞的连接；
+// 没有事件时按指数退避再检查一次，事件流打不开或中断时退化为纯退避轮询
+class EventWaiter
+{
+public:
+    // activity切换相关的事件，不同版本的名称不同，都订阅即可
+    static QStringList activityTags()
+    {
+        return {
+            "am_resume_activity", "am_set_resumed_activity", "am_on_resume_called", "am_focused_stack",
+            "am_activity_launch_time", "wm_set_resumed_activity", "wm_on_resume_called",
+            "wm_focused_root_task", "wm_activity_launch_time",
+        };
+    }
+
+    // maxIdle: 有事件流时两次检查的最大间隔，没有事件流时不超过 MaxPoll
+    EventWaiter(const QString& serial, const QStringList& tags = activityTags(), int maxIdle = 1000)
+        : maxIdle(maxIdle)
+    {
+        // 从设备的当前时间开始，-T 1 会回放最后一条旧事件，第一次等待就被它唤醒
+        auto cmd = "exec:logcat -b events -T \"$(date +'%m-%d %H:%M:%S.000')\" -s " + tags.join(' ').toUtf8();
+        if (!AdbClient::open(sock, serial, cmd)) sock.close();
+    }
+
+    bool streaming() const { return sock.isOpen(); }
+
+    // 等到下一次该检查的时候，剩余时间remaining(毫秒)用完或被取消时返回false
+    bool wait(qint64 remaining, const CancelToken& token = CancelToken())
+    {
+        if (remaining <= 0 || token.cancelled()) return false;
+        qint64 slice = qMin<qint64>(remaining, interval);
+
+        // 第一次检查之前到达的事件已经反映在检查结果里
+        if (first)
+        {
+            first = false;
+            drain(0);
+        }
+
+        QElapsedTimer t;
+        t.start();
+        while (t.elapsed() < slice)
+        {
+            if (token.cancelled()) return false;
+            if (!sock.isOpen())
+            {
+                QThread::msleep(ulong(qMin<qint64>(Slice, slice - t.elapsed())));
+                continue;
+            }
+
+            if (!sock.waitReadable(int(qBound<qint64>(0, slice - t.elapsed(), Slice)))) continue;
+            char buf[4096];
+            if (sock.read(buf, sizeof(buf)) > 0)
+            {
+                // 一次切换会连续产生几条事件，稍等片刻合并成一次检查
+                drain(Settle);
+                interval = MinPoll;
+                return true;
+            }
+            sock.close();
+        }
+
+        // 没有事件，拉长下一次的间隔
+        interval = qMin(interval * 2, sock.isOpen() ? maxIdle : qMin(maxIdle, int(MaxPoll)));
+        return !token.cancelled();
+    }
+
+private:
+    enum
+    {
+        MinPoll = 100,      // 退避的起始间隔
+        MaxPoll = 1000,     // 没有事件流时的最大间隔
+        Slice = 100,        // 单次阻塞的上限，用于及时响应取消
+        Settle = 30,
+    };
+
+    // 读掉ms毫秒内到达的事件
+    void drain(int ms)
+    {
+        char buf[4096];
+        QElapsedTimer t;
+        t.start();
+        while (sock.isOpen() && t.elapsed() <= ms && sock.waitReadable(int(qMax<qint64>(0, ms - t.elapsed()))))
+            if (sock.read(buf, sizeof(buf)) <= 0) sock.close();
+    }
+
+    AdbSocket sock;
+    int maxIdle;
+    int interval = MinPoll;
+    bool first = true;
+};
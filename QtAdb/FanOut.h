@@ -0,0 +1,157 @@
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <functional>
+
+#include "InputInjector.h"
+
+// 在多台设备上并行执行同一组操作
+// 并发数由独立的线程池限制，每台设备完成后立即通过信号回报结果
+class FanOut : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 单台设备上的操作，输出追加到out，返回是否成功
+    typedef std::function<bool(AdbDevice*, const CancelToken&, QString& out)> Task;
+
+    struct Result
+    {
+        QString device;
+        QString output;
+        bool ok = false;
+        qint64 ms = 0;      // 该设备耗时
+    };
+
+    FanOut(QObject *parent, int limit = 8): QObject(parent)
+    {
+        pool.setMaxThreadCount(limit);
+    }
+
+    ~FanOut()
+    {
+        token.cancel();
+        pool.waitForDone();
+    }
+
+    // 上一轮还有设备未完成时拒绝执行，返回false
+    bool run(const QList<AdbDevice*>& devs, const Task& task)
+    {
+        if (remaining > 0) return false;
+        results.clear();
+        remaining = devs.size();
+        token = CancelToken();  // 上一轮的取消不影响本轮
+        timer.start();
+        if (devs.isEmpty())
+        {
+            emit finished();
+            return true;
+        }
+
+        for (auto dev : devs)
+        {
+            QtConcurrent::run(&pool, [this, dev, task, token = token] {
+                Result r;
+                r.device = dev->name;
+                QElapsedTimer t;
+                t.start();
+                r.ok = !token.cancelled() && task(dev, token, r.output);
+                r.ms = t.elapsed();
+                QMetaObject::invokeMethod(this, [this, r] { onResult(r); }, Qt::QueuedConnection);
+            });
+        }
+        return true;
+    }
+
+    void cancel() { token.cancel(); }
+
+    const QList<Result>& allResults() const { return results; }
+
+    // 汇总: 成功数和耗时分布
+    QString summary() const
+    {
+        qint64 lo = results.size() ? results[0].ms : 0, hi = 0, sum = 0;
+        int ok = 0;
+        for (auto& r : results)
+        {
+            if (r.ok) ++ok;
+            lo = qMin(lo, r.ms);
+            hi = qMax(hi, r.ms);
+            sum += r.ms;
+        }
+        return QString("[并行] %1/%2 成功, 总耗时 %3 ms, 单台 最小 %4 / 平均 %5 / 最大 %6 ms")
+            .arg(ok).arg(results.size()).arg(timer.elapsed())
+            .arg(lo).arg(results.size() ? sum / results.size() : 0).arg(hi);
+    }
+
+    // ---- 常用操作 ----
+
+    static Task shell(const QString& cmd, bool root = false)
+    {
+        return [=](AdbDevice *dev, const CancelToken&, QString& out) {
+            auto r = dev->shell({ cmd }, root);
+            out += QString(r);
+            return r.succeeded();
+        };
+    }
+
+    static Task startApp(const QString& pkg_act)
+    {
+        return [=](AdbDevice *dev, const CancelToken&, QString&) {
+            return dev->start_app(pkg_act);
+        };
+    }
+
+    static Task tap(int x, int y)
+    {
+        return [=](AdbDevice *dev, const CancelToken&, QString&) {
+            return dev->tap(x, y);
+        };
+    }
+
+    // 一组输入操作，如 FanOut::input([](InputInjector& in) { in.tap(100, 200).wait(500).key("KEYCODE_BACK"); })
+    static Task input(const std::function<void(InputInjector&)>& build)
+    {
+        return [=](AdbDevice *dev, const CancelToken& token, QString&) {
+            return dev->inject(build, token);
+        };
+    }
+
+    static Task clickCtrl(const QString& text, int ms = 10 * 1000)
+    {
+        return [=](AdbDevice *dev, const CancelToken& token, QString& out) {
+            if (dev->click_ctrl(text, ms, token)) return true;
+            out += "未找到控件: " + text + "\n";
+            return false;
+        };
+    }
+
+    // 依次执行多个操作，遇到失败或取消即停止
+    static Task sequence(const QList<Task>& steps)
+    {
+        return [=](AdbDevice *dev, const CancelToken& token, QString& out) {
+            for (auto& step : steps)
+                if (token.cancelled() || !step(dev, token, out)) return false;
+            return true;
+        };
+    }
+
+Q_SIGNALS:
+    void deviceFinished(const FanOut::Result& r);
+    void finished();
+
+private:
+    void onResult(const Result& r)
+    {
+        results.push_back(r);
+        emit deviceFinished(r);
+        if (--remaining == 0) emit finished();
+    }
+
+    QThreadPool pool;
+    CancelToken token;
+    QElapsedTimer timer;
+    QList<Result> results;
+    int remaining = 0;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#define FASTSCAN_SSE2
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define FASTSCAN_AVX2
+#else
+#define FASTSCAN_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// 大块输出的向量化扫描: 换行定位、空白分隔的字段边界
+// x64下使用SSE2，CPU支持时换行扫描使用AVX2，其他平台退回标量实现
+struct FastScan
+{
+    static bool isSpace(char c) { return c == ' ' || (unsigned char)(c - 9) <= 4; }
+
+    // 对每个'\n'的位置调用 f(pos)
+    template<class F>
+    static void forEachNewline(const char *p, int n, F f)
+    {
+        int i = 0;
+#ifdef FASTSCAN_SSE2
+        i = hasAvx2() ? newlinesAvx2(p, n, f) : newlinesSse2(p, n, f);
+#endif
+        for (; i < n; ++i)
+            if (p[i] == '\n') f(i);
+    }
+
+    // 从i开始第一个非空白字符的位置
+    static int skipSpace(const char *p, int i, int n)
+    {
+#ifdef FASTSCAN_SSE2
+        for (; i + 16 <= n; i += 16)
+        {
+            unsigned m = spaceMask(p + i) ^ 0xFFFF;
+            if (m) return i + ctz(m);
+        }
+#endif
+        while (i < n && isSpace(p[i])) ++i;
+        return i;
+    }
+
+    // 从i开始第一个空白字符的位置
+    static int findSpace(const char *p, int i, int n)
+    {
+#ifdef FASTSCAN_SSE2
+        for (; i + 16 <= n; i += 16)
+        {
+            unsigned m = spaceMask(p + i);
+            if (m) return i + ctz(m);
+        }
+#endif
+        while (i < n && !isSpace(p[i])) ++i;
+        return i;
+    }
+
+    // 一次扫描得到所有字段边界，对每个字段调用 f(begin, end)，f返回false时停止
+    template<class F>
+    static void forEachField(const char *p, int n, F f)
+    {
+        int i = 0;
+        int b = 0;
+        bool inField = false;
+#ifdef FASTSCAN_SSE2
+        unsigned carry = 1;     // 开头视为空白
+        for (; i + 16 <= n; i += 16)
+        {
+            unsigned s = spaceMask(p + i);
+            unsigned t = (s ^ ((s << 1) | carry)) & 0xFFFF;     // 空白/非空白的切换点
+            carry = (s >> 15) & 1;
+            while (t)
+            {
+                int pos = i + ctz(t);
+                t &= t - 1;
+                if (!inField) b = pos;
+                else if (!f(b, pos)) return;
+                inField = !inField;
+            }
+        }
+#endif
+        for (; i < n; ++i)
+        {
+            bool sp = isSpace(p[i]);
+            if (!inField && !sp) b = i, inField = true;
+            else if (inField && sp)
+            {
+                inField = false;
+                if (!f(b, i)) return;
+            }
+        }
+        if (inField) f(b, n);
+    }
+
+    // 最低位的1的位置，m不能为0
+    static int ctz(unsigned m)
+    {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward(&i, m);
+        return int(i);
+#else
+        return __builtin_ctz(m);
+#endif
+    }
+
+private:
+
+#ifdef FASTSCAN_SSE2
+    static bool hasAvx2()
+    {
+        static const bool avx2 = [] {
+#ifdef _MSC_VER
+            int r[4];
+            __cpuid(r, 0);
+            if (r[0] < 7) return false;
+            __cpuid(r, 1);
+            if (!(r[2] & (1 << 27))) return false;      // OSXSAVE
+            if ((_xgetbv(0) & 6) != 6) return false;    // 系统保存YMM寄存器
+            __cpuidex(r, 7, 0);
+            return (r[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }();
+        return avx2;
+    }
+
+    // 16字节中空白字符(空格、\t \n \v \f \r)的位掩码
+    static unsigned spaceMask(const char *p)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+        __m128i x = _mm_sub_epi8(v, _mm_set1_epi8(9));
+        __m128i ctl = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(-1)), _mm_cmplt_epi8(x, _mm_set1_epi8(5)));
+        return unsigned(_mm_movemask_epi8(_mm_or_si128(sp, ctl)));
+    }
+
+    template<class F>
+    static int newlinesSse2(const char *p, int n, F& f)
+    {
+        const __m128i nl = _mm_set1_epi8('\n');
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i)), nl));
+            while (m)
+            {
+                f(i + ctz(m));
+                m &= m - 1;
+            }
+        }
+        return i;
+    }
+
+    template<class F>
+    FASTSCAN_AVX2 static int newlinesAvx2(const char *p, int n, F& f)
+    {
+        const __m256i nl = _mm256_set1_epi8('\n');
+        int i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            unsigned m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(p + i)), nl));
+            while (m)
+            {
+                f(i + ctz(m));
+                m &= m - 1;
+            }
+        }
+        return i;
+    }
+#endif
+};
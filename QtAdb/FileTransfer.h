@@ -0,0 +1,423 @@
+#pragma once
+
+#include <QObject>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "AdbDevice.h"
+
+// 基于sync协议的文件上传/下载
+// 多条sync连接并发，目录展开成文件加入公共队列，任意连接空闲即取下一个
+// 同一连接上的上传连续发送，不等待逐个应答；下载到 .part 文件，中断后再次下载时从断点继续
+// 连接经由 AdbClient，设置 ANDROID_ADB_SERVER_PORT 即可指向模拟的adb server
+class FileTransfer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Job
+    {
+        bool push = false;
+        bool dir = false;
+        QString local;
+        QString remote;
+        quint32 mode = 0644;
+        bool statted = false;   // 下载: 展开目录时已取得远端的大小和修改时间
+        quint64 size = 0;
+        qint64 mtime = 0;
+    };
+
+    FileTransfer(AdbDevice *dev, QObject *parent, int connections = 4)
+        : QObject(parent), dev(dev), connections(connections)
+    {
+        pool.setMaxThreadCount(connections);
+        connect(&timer, &QTimer::timeout, this, &FileTransfer::report);
+    }
+
+    ~FileTransfer()
+    {
+        token.cancel();
+        pool.waitForDone();
+    }
+
+    // 上传文件或目录到设备上的remoteDir下
+    void push(const QString& local, const QString& remoteDir)
+    {
+        QFileInfo fi(local);
+        Job j;
+        j.push = true;
+        j.dir = fi.isDir();
+        j.local = fi.absoluteFilePath();
+        j.remote = join(remoteDir, fi.fileName());
+        if (!j.dir) totalBytes.fetchAndAddRelaxed(fi.size());
+        jobs.push_back(j);
+    }
+
+    // 下载设备上的文件或目录到localDir下
+    void pull(const QString& remote, const QString& localDir, bool dir = false)
+    {
+        Job j;
+        j.dir = dir;
+        j.remote = remote;
+        j.local = QDir(localDir).filePath(remote.mid(remote.lastIndexOf('/') + 1));
+        jobs.push_back(j);
+    }
+
+    void start()
+    {
+        timer.start(250);
+        clock.start();
+        for (auto& j : jobs) enqueue(j);
+        jobs.clear();
+        running = connections;
+        for (int i = 0; i < connections; ++i)
+        {
+            QtConcurrent::run(&pool, [this] {
+                worker();
+                QMetaObject::invokeMethod(this, [this] {
+                    if (--running == 0) finish();
+                }, Qt::QueuedConnection);
+            });
+        }
+    }
+
+    void cancel()
+    {
+        token.cancel();
+        cond.wakeAll();
+    }
+
+    int failedCount() const { return failed.load(); }
+
+    // 进度: 已传输/总字节数，已完成/总文件数，速度(字节/秒)
+    QString summary() const
+    {
+        return QString("[传输] %1 个文件, %2 失败, %3, 用时 %4 秒, 平均 %5/s")
+            .arg(filesDone.load()).arg(failed.load()).arg(sizeText(bytes.load() / 1024.0f))
+            .arg(clock.elapsed() / 1000.0, 0, 'f', 1)
+            .arg(sizeText(bytes.load() / 1024.0f / qMax<qint64>(1, clock.elapsed()) * 1000));
+    }
+
+Q_SIGNALS:
+    void progress(qint64 done, qint64 total, int files, int totalFiles, double rate);
+    void fileFailed(const QString& path, const QString& err);
+    void finished();
+
+private:
+    static QString join(const QString& dir, const QString& name)
+    {
+        return dir.endsWith('/') ? dir + name : dir + '/' + name;
+    }
+
+    static QString sizeText(float kb)
+    {
+        if (kb < 1) return QString("%1 B").arg(int(kb * 1024));
+        const char *units[] = { "KB", "MB", "GB", "TB" };
+        int i = 0;
+        while (kb > 1024 && i < 3) kb /= 1024, ++i;
+        return QString::number(kb, 'f', 1) + ' ' + units[i];
+    }
+
+    void enqueue(const Job& j, bool retry = false)
+    {
+        QMutexLocker lock(&mutex);
+        queue.enqueue(j);
+        if (!j.dir && !retry) filesTotal.fetchAndAddRelaxed(1);
+        cond.wakeOne();
+    }
+
+    // 取下一个任务，队列空且没有任务在展开目录时结束
+    bool take(Job& j)
+    {
+        QMutexLocker lock(&mutex);
+        for (;;)
+        {
+            if (token.cancelled()) return false;
+            if (!queue.isEmpty())
+            {
+                j = queue.dequeue();
+                ++active;
+                return true;
+            }
+            if (active == 0)
+            {
+                cond.wakeAll();
+                return false;
+            }
+            cond.wait(&mutex, 100);
+        }
+    }
+
+    void done()
+    {
+        QMutexLocker lock(&mutex);
+        --active;
+        cond.wakeAll();
+    }
+
+    void fail(const Job& j, const QString& err)
+    {
+        failed.fetchAndAddRelaxed(1);
+        auto path = j.push ? j.local : j.remote;
+        QMetaObject::invokeMethod(this, [this, path, err] { emit fileFailed(path, err); }, Qt::QueuedConnection);
+    }
+
+    void worker()
+    {
+        AdbSync sync(dev->name, dev->hasFeature("ls_v2") && dev->hasFeature("stat_v2"));
+        QList<Job> unacked;     // 已发送、尚未取回结果的上传
+
+        // 返回重新排队的任务数
+        auto settle = [&](int keep) {
+            while (sync.pendingAcks() > keep)
+            {
+                QString err;
+                auto j = unacked.takeFirst();
+                if (sync.readAck(&err)) filesDone.fetchAndAddRelaxed(1);
+                else fail(j, err);
+            }
+            // 连接断开后未确认的上传重新排队，已计入进度的字节数重新计入总数
+            int requeued = 0;
+            while (unacked.size() > sync.pendingAcks())
+            {
+                auto j = unacked.takeLast();
+                totalBytes.fetchAndAddRelaxed(QFileInfo(j.local).size());
+                enqueue(j, true);
+                ++requeued;
+            }
+            return requeued;
+        };
+
+        // 最后取回应答时也可能有任务重新排队，此时其他连接可能已经退出，由本连接接着处理
+        Job j;
+        do
+        {
+            while (take(j))
+            {
+                if (j.dir) expand(sync, j);
+                else if (j.push)
+                {
+                    if (pushFile(sync, j)) unacked.push_back(j);
+                    settle(8);
+                }
+                else pullFile(sync, j);
+                done();
+            }
+        } while (settle(0) && !token.cancelled());
+    }
+
+    void expand(AdbSync& sync, const Job& j)
+    {
+        if (j.push)
+        {
+            QDir d(j.local);
+            auto list = d.entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+            // SEND会自动创建上级目录，空目录需要单独创建
+            if (list.isEmpty()) dev->shell({ "mkdir", "-p", AdbDevice::quote(j.remote) });
+            for (auto& fi : list)
+            {
+                Job c;
+                c.push = true;
+                c.dir = fi.isDir();
+                c.local = fi.absoluteFilePath();
+                c.remote = join(j.remote, fi.fileName());
+                if (!c.dir) totalBytes.fetchAndAddRelaxed(fi.size());
+                enqueue(c);
+            }
+            return;
+        }
+
+        QString err;
+        QVector<AdbSync::Entry> list;
+        if (!sync.list(j.remote, list, &err)) return fail(j, err);
+        QDir().mkpath(j.local);
+
+        // 指向文件的链接按文件下载，指向目录的不跟随，避免循环
+        QStringList links;
+        for (auto& e : list)
+            if (e.isLink()) links.push_back(join(j.remote, e.name));
+        QVector<AdbSync::Entry> targets;
+        if (links.size() && !sync.stat(links, targets, true, &err)) targets.clear();
+
+        int li = 0;
+        for (auto& e : list)
+        {
+            auto t = e;
+            if (e.isLink())
+            {
+                if (li >= targets.size()) continue;
+                t = targets[li++];
+                t.name = e.name;
+                if (!t.isFile()) continue;
+            }
+            if (!t.isDir() && !t.isFile()) continue;
+
+            Job c;
+            c.dir = t.isDir();
+            c.remote = join(j.remote, t.name);
+            c.local = QDir(j.local).filePath(t.name);
+            c.statted = true;
+            c.size = t.size;
+            c.mtime = t.mtime;
+            if (!c.dir) totalBytes.fetchAndAddRelaxed(qint64(t.size));
+            enqueue(c);
+        }
+    }
+
+    bool pushFile(AdbSync& sync, const Job& j)
+    {
+        QFile f(j.local);
+        if (!f.open(QIODevice::ReadOnly))
+        {
+            fail(j, f.errorString());
+            return false;
+        }
+
+        QString err;
+        auto mode = f.permissions() & QFile::ExeOwner ? 0755 : 0644;
+        auto mtime = QFileInfo(f).lastModified().toSecsSinceEpoch();
+        if (sync.sendFile(j.remote, mode, mtime, f, [this](int n) { return add(n); }, &err)) return true;
+        fail(j, err);
+        return false;
+    }
+
+    void pullFile(AdbSync& sync, const Job& j)
+    {
+        QString err;
+        AdbSync::Entry e;
+        e.size = j.size;
+        e.mtime = j.mtime;
+        if (!j.statted && !remoteStat(sync, j.remote, e, &err)) return fail(j, err);
+
+        // .part 对应的远端版本(大小和修改时间)记在 .part.info 中，不一致时重新下载，
+        // 否则旧版本的开头会和新版本的剩余部分拼在一起
+        QFile f(j.local + ".part");
+        QFile info(j.local + ".part.info");
+        auto stamp = QByteArray::number(qint64(e.size)) + ' ' + QByteArray::number(e.mtime);
+        qint64 have = f.exists() ? f.size() : 0;
+        if (have && (have > qint64(e.size) || !info.open(QIODevice::ReadOnly) || info.readAll() != stamp)) have = 0;
+        info.close();
+        // 记录失败只影响下次续传
+        if (!have && info.open(QIODevice::WriteOnly | QIODevice::Truncate)) info.write(stamp), info.close();
+        if (!f.open(have ? QIODevice::Append : QIODevice::WriteOnly))
+            return fail(j, f.errorString());
+
+        bool ok;
+        if (have)
+        {
+            // 断点续传: sync协议不支持偏移，用exec服务取剩余部分
+            add(have);
+            ok = resume(j.remote, have, qint64(e.size), f, &err);
+        }
+        else ok = sync.recvFile(j.remote, f, [this](int n) { return add(n); }, &err);
+        f.close();
+
+        if (!ok) return fail(j, err);
+        QFile::remove(j.local);
+        if (!f.rename(j.local)) return fail(j, f.errorString());
+        info.remove();
+        filesDone.fetchAndAddRelaxed(1);
+    }
+
+    // 不跟随链接查询，是链接时再查询其目标(v1协议跟随链接只能查目录)
+    static bool remoteStat(AdbSync& sync, const QString& remote, AdbSync::Entry& e, QString *err)
+    {
+        bool found = sync.stat(remote, e, false, err);
+        if (found && e.isLink()) found = sync.stat(remote, e, true, err);
+        if (!found && err && err->isEmpty()) *err = "remote file not found";
+        return found;
+    }
+
+    // 从offset处接着下载，exec服务的输出没有分包，标准错误丢弃以免混入数据
+    bool resume(const QString& remote, qint64 offset, qint64 size, QFile& out, QString *err)
+    {
+        AdbSocket s;
+        auto cmd = "exec:tail -c +" + QByteArray::number(offset + 1) + " " + AdbDevice::quote(remote).toUtf8() + " 2>/dev/null";
+        if (!AdbClient::open(s, dev->name, cmd, err)) return false;
+        s.setBufferSize(1024 * 1024);
+
+        qint64 received = 0;
+        QByteArray buf(AdbSync::MaxChunk, Qt::Uninitialized);
+        for (;;)
+        {
+            int r = s.read(buf.data(), buf.size());
+            if (r == 0) break;
+            if (r < 0)
+            {
+                if (err) *err = "connection broken";
+                return false;
+            }
+            if (out.write(buf.constData(), r) != r)
+            {
+                if (err) *err = out.errorString();
+                return false;
+            }
+            received += r;
+            if (!add(r))
+            {
+                if (err) *err = "cancelled";
+                return false;
+            }
+        }
+        if (offset + received == size) return true;
+        if (err) *err = QString("size mismatch: expected %1, got %2").arg(size).arg(offset + received);
+        return false;
+    }
+
+    bool add(qint64 n)
+    {
+        bytes.fetchAndAddRelaxed(n);
+        return !token.cancelled();
+    }
+
+    void report()
+    {
+        // 速度取最近一段时间的平滑值
+        qint64 now = clock.elapsed();
+        qint64 b = bytes.load();
+        if (now > lastTime)
+        {
+            double r = (b - lastBytes) * 1000.0 / (now - lastTime);
+            rate = rate ? rate * 0.7 + r * 0.3 : r;
+        }
+        lastTime = now, lastBytes = b;
+        emit progress(b, totalBytes.load(), filesDone.load(), filesTotal.load(), rate);
+    }
+
+    void finish()
+    {
+        timer.stop();
+        report();
+        emit finished();
+    }
+
+    AdbDevice *dev;
+    int connections;
+    int running = 0;
+    QList<Job> jobs;            // start之前添加的任务
+
+    QThreadPool pool;
+    CancelToken token;
+    QMutex mutex;
+    QWaitCondition cond;
+    QQueue<Job> queue;
+    int active = 0;             // 正在处理的任务数
+
+    QAtomicInteger<qint64> bytes;
+    QAtomicInteger<qint64> totalBytes;
+    QAtomicInt filesDone;
+    QAtomicInt filesTotal;
+    QAtomicInt failed;
+
+    QTimer timer;
+    QElapsedTimer clock;
+    qint64 lastTime = 0;
+    qint64 lastBytes = 0;
+    double rate = 0;
+};
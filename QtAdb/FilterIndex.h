@@ -0,0 +1,266 @@
+#pragma once
+
+#include <QByteArrayMatcher>
+#include <QHash>
+#include <QModelIndex>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QVector>
+#include <algorithm>
+#include <functional>
+
+#include "AdbAsync.h"
+
+// 过滤条件
+// 普通文本: 任一列包含(不区分大小写)；"列名:文本": 只匹配该列；"/表达式/": 正则
+struct FilterQuery
+{
+    QByteArray text;        // 小写UTF-8
+    QRegularExpression re;
+    bool regex = false;
+    int column = -1;        // -1为任一列
+
+    static FilterQuery parse(QString s, const QStringList& headers)
+    {
+        FilterQuery q;
+        int colon = s.indexOf(':');
+        for (int c = 0; colon > 0 && c < headers.size(); ++c)
+        {
+            if (s.leftRef(colon).compare(headers[c], Qt::CaseInsensitive) == 0)
+            {
+                q.column = c;
+                s = s.mid(colon + 1);
+                break;
+            }
+        }
+
+        if (s.size() > 2 && s.startsWith('/') && s.endsWith('/'))
+        {
+            q.re = QRegularExpression(s.mid(1, s.size() - 2), QRegularExpression::CaseInsensitiveOption);
+            q.regex = q.re.isValid();
+        }
+        if (!q.regex) q.text = s.toLower().toUtf8();
+        return q;
+    }
+
+    bool isEmpty() const { return !regex && text.isEmpty(); }
+
+    // 满足本条件的行一定满足prev，可以只在prev的结果中筛选
+    bool narrows(const FilterQuery& prev) const
+    {
+        return !regex && !prev.regex && column == prev.column && text.contains(prev.text);
+    }
+};
+
+// 生成若干行各列的小写UTF-8文本，在过滤线程上执行
+typedef std::function<void(QVector<QVector<QByteArray>>& rows)> FilterRows;
+
+// 能提供数据快照的模型，过滤索引在后台线程上取文本，不经过界面线程的data()
+class FilterSource
+{
+public:
+    virtual ~FilterSource() {}
+
+    // rows为各行第0列的索引，返回的函数只能访问快照，不能访问模型
+    virtual FilterRows filterRows(const QModelIndexList& rows) const = 0;
+};
+
+// 行文本的三字节组倒排索引
+// 各列文本以'\0'分隔连续存放，查询时先用倒排表求交得到候选行，再逐行核对
+// 删除的行只做标记，不再出现在查询结果中
+class TrigramIndex
+{
+public:
+    int size() const { return rows; }
+
+    void clear()
+    {
+        buf.clear();
+        starts.clear();
+        postings.clear();
+        dead.clear();
+        rows = cols = 0;
+    }
+
+    void remove(int id)
+    {
+        if (id >= 0 && id < rows) dead[id] = true;
+    }
+
+    // 添加一行，cells为各列的小写UTF-8文本，返回行号
+    int append(const QVector<QByteArray>& cells)
+    {
+        int id = rows++;
+        if (!cols) cols = cells.size();
+        dead.push_back(false);
+
+        int b = buf.size();
+        for (int c = 0; c < cols; ++c)
+        {
+            starts.push_back(buf.size());
+            if (c < cells.size()) buf.append(cells[c]);
+            buf.append('\0');
+        }
+
+        auto p = buf.constData();
+        for (int i = b; i + 3 <= buf.size(); ++i)
+        {
+            if (!p[i] || !p[i + 1] || !p[i + 2]) continue;
+            auto& list = postings[key(p + i)];
+            if (list.isEmpty() || list.last() != id) list.push_back(id);
+        }
+        return id;
+    }
+
+    // 满足条件的行号(升序)，within不为空时只在其中查找
+    QVector<int> query(const FilterQuery& q, const QVector<int> *within = nullptr) const
+    {
+        QVector<int> cand;
+        if (!q.regex && q.text.size() >= 3)
+        {
+            QVector<const QVector<int>*> lists;
+            for (int i = 0; i + 3 <= q.text.size(); ++i)
+            {
+                auto it = postings.constFind(key(q.text.constData() + i));
+                if (it == postings.cend()) return QVector<int>();
+                lists.push_back(&*it);
+            }
+            // 从最短的倒排表开始求交
+            std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) {
+                return a->size() < b->size();
+            });
+            cand = within ? intersect(*within, *lists[0]) : *lists[0];
+            for (int i = 1; i < lists.size() && cand.size(); ++i)
+                cand = intersect(cand, *lists[i]);
+        }
+        else if (within) cand = *within;
+        else
+        {
+            cand.resize(rows);
+            for (int i = 0; i < rows; ++i) cand[i] = i;
+        }
+
+        QVector<int> out;
+        QByteArrayMatcher m(q.text);
+        for (int id : cand)
+            if (!dead[id] && match(q, m, id)) out.push_back(id);
+        return out;
+    }
+
+private:
+    static quint32 key(const char *p)
+    {
+        return quint32(uchar(p[0])) | quint32(uchar(p[1])) << 8 | quint32(uchar(p[2])) << 16;
+    }
+
+    // a通常远小于b，在b中二分查找a的元素
+    static QVector<int> intersect(const QVector<int>& a, const QVector<int>& b)
+    {
+        if (a.size() > b.size()) return intersect(b, a);
+        QVector<int> out;
+        auto it = b.cbegin();
+        for (int x : a)
+        {
+            it = std::lower_bound(it, b.cend(), x);
+            if (it == b.cend()) break;
+            if (*it == x) out.push_back(x);
+        }
+        return out;
+    }
+
+    bool match(const FilterQuery& q, const QByteArrayMatcher& m, int id) const
+    {
+        int c0 = q.column >= 0 ? q.column : 0;
+        int c1 = q.column >= 0 ? q.column + 1 : cols;
+        for (int c = c0; c < c1; ++c)
+        {
+            int i = id * cols + c;
+            int b = starts[i];
+            int n = (i + 1 < starts.size() ? starts[i + 1] : buf.size()) - 1 - b;
+            if (q.regex)
+            {
+                if (q.re.match(QString::fromUtf8(buf.constData() + b, n)).hasMatch()) return true;
+            }
+            else if (m.indexIn(buf.constData() + b, n) >= 0) return true;
+        }
+        return false;
+    }
+
+    QByteArray buf;
+    QVector<int> starts;        // 每个单元格在buf中的起始位置
+    QHash<quint32, QVector<int>> postings;
+    QVector<bool> dead;         // 已删除的行
+    int rows = 0;
+    int cols = 0;
+};
+
+// 在单独的线程上维护索引和执行查询，操作按提交顺序依次执行
+// 查询条件是上一次的扩展时只在上一次的结果中筛选
+class FilterEngine
+{
+public:
+    FilterEngine(): d(new Data)
+    {
+        pool.setMaxThreadCount(1);
+    }
+
+    ~FilterEngine()
+    {
+        pool.waitForDone();
+    }
+
+    void reset()
+    {
+        auto d = this->d;
+        QtConcurrent::run(&pool, [d] {
+            d->index.clear();
+            d->hasLast = false;
+        });
+    }
+
+    // 依次添加rows生成的各行，行号接着已有的行
+    void append(const FilterRows& rows)
+    {
+        auto d = this->d;
+        QtConcurrent::run(&pool, [d, rows] {
+            QVector<QVector<QByteArray>> cells;
+            rows(cells);
+            for (auto& r : cells) d->index.append(r);
+            d->hasLast = false;
+        });
+    }
+
+    // 删除的行号不会再被查询到，上一次的结果仍可用于缩小范围
+    void remove(const QVector<int>& ids)
+    {
+        auto d = this->d;
+        QtConcurrent::run(&pool, [d, ids] {
+            for (int id : ids) d->index.remove(id);
+        });
+    }
+
+    // 返回满足条件的行号
+    QFuture<QVector<int>> query(const FilterQuery& q)
+    {
+        auto d = this->d;
+        return QtConcurrent::run(&pool, [d, q] {
+            auto r = d->index.query(q, d->hasLast && q.narrows(d->last) ? &d->lastResult : nullptr);
+            d->last = q;
+            d->lastResult = r;
+            d->hasLast = true;
+            return r;
+        });
+    }
+
+private:
+    struct Data
+    {
+        TrigramIndex index;
+        FilterQuery last;
+        QVector<int> lastResult;
+        bool hasLast = false;
+    };
+
+    QSharedPointer<Data> d;
+    QThreadPool pool;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <QDirIterator>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+
+#include "AdbDevice.h"
+
+// 本地目录同步到设备: 比较两边的文件大小和修改时间，只上传有变化的文件
+// 设备端整棵树一次find取回，可选的校验和也是批量计算，不论文件多少都只需几次往返
+struct FolderSync
+{
+    struct Plan
+    {
+        QStringList files;      // 需要上传的文件，相对路径
+        int unchanged = 0;
+        qint64 bytes = 0;       // 需要上传的字节数
+    };
+
+    // hash为true时，大小相同而时间不同的文件再比较md5，内容相同的不上传
+    static Plan plan(AdbDevice *dev, const QString& localRoot, const QString& remoteRoot, bool hash = false)
+    {
+        struct Remote { qint64 size, mtime; };
+        QHash<QString, Remote> remote;
+
+        // 大小 修改时间 路径
+        auto root = remoteRoot.endsWith('/') ? remoteRoot : remoteRoot + '/';
+        auto out = dev->shell({ "find", AdbDevice::quote(root), "-type", "f", "-exec", "stat", "-c", "'%s %Y %n'", "{}", "+", "2>/dev/null" });
+        for (auto line : out.lineViews())
+        {
+            LineView p(line);
+            Remote r;
+            r.size = p.next().toLongLong();
+            r.mtime = p.next().toLongLong();
+            auto path = p.rest().toString();
+            if (path.startsWith(root)) remote.insert(path.mid(root.size()), r);
+        }
+
+        Plan plan;
+        QStringList suspect;    // 大小相同、时间不同
+        QDir base(localRoot);
+        QDirIterator it(localRoot, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+        while (it.hasNext())
+        {
+            it.next();
+            auto fi = it.fileInfo();
+            auto rel = base.relativeFilePath(fi.filePath());
+            auto r = remote.constFind(rel);
+            if (r != remote.cend() && r->size == fi.size())
+            {
+                if (r->mtime == fi.lastModified().toSecsSinceEpoch()) ++plan.unchanged;
+                else if (hash) suspect.push_back(rel);
+                else plan.files.push_back(rel);
+                continue;
+            }
+            plan.files.push_back(rel);
+        }
+
+        if (suspect.size())
+        {
+            auto sums = remoteMd5(dev, root, suspect);
+            for (auto& rel : suspect)
+            {
+                if (sums.value(rel) == localMd5(base.filePath(rel))) ++plan.unchanged;
+                else plan.files.push_back(rel);
+            }
+        }
+
+        for (auto& rel : plan.files) plan.bytes += QFileInfo(base.filePath(rel)).size();
+        return plan;
+    }
+
+private:
+    // 按命令行长度分批，所有批次在常驻会话中一次发送
+    static QHash<QString, QByteArray> remoteMd5(AdbDevice *dev, const QString& root, const QStringList& files)
+    {
+        const int maxCmd = 64 * 1024;
+        QStringList cmds;
+        QString cmd;
+        for (auto& f : files)
+        {
+            if (cmd.size() > maxCmd) cmds.push_back(cmd), cmd.clear();
+            if (cmd.isEmpty()) cmd = "md5sum";
+            cmd += ' ' + AdbDevice::quote(root + f);
+        }
+        if (cmd.size()) cmds.push_back(cmd);
+
+        // md5 两个空格 路径
+        QHash<QString, QByteArray> sums;
+        for (auto& r : dev->shellBatch(cmds))
+        {
+            for (auto line : r.lineViews())
+            {
+                LineView p(line);
+                auto sum = p.next().toByteArray();
+                auto path = p.rest().toString();
+                if (path.startsWith(root)) sums.insert(path.mid(root.size()), sum);
+            }
+        }
+        return sums;
+    }
+
+    static QByteArray localMd5(const QString& path)
+    {
+        QFile f(path);
+        if (!f.open(QIODevice::ReadOnly)) return QByteArray();
+        QCryptographicHash h(QCryptographicHash::Md5);
+        h.addData(&f);
+        return h.result().toHex();
+    }
+};
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QElapsedTimer>
+#include <algorithm>
+
+#include "AdbDevice.h"
+
+// 批量输入: 点击、滑动、按键、文字按顺序执行，可指定间隔
+// 点击和滑动直接把 input_event 写入触摸屏的 /dev/input/eventN，经一条常驻的exec连接发送，
+// 不需要每次启动 input 命令(每次都要起一个虚拟机，约300ms)；时序由本机控制
+// 按键和文字合并成一条shell命令在常驻会话中执行；设备不允许写触摸屏时整个序列都走shell
+// 屏幕旋转时 input 的坐标跟着旋转而触摸屏的坐标不变，按当前方向换算，读不到方向时点击和滑动也走shell
+class InputInjector
+{
+public:
+    InputInjector(AdbDevice *dev): dev(dev) {}
+
+    InputInjector& tap(int x, int y, int hold = 40)
+    {
+        Op o;
+        o.type = Op::Tap;
+        o.x1 = x, o.y1 = y, o.ms = hold;
+        ops.push_back(o);
+        return *this;
+    }
+
+    InputInjector& tap(const AdbDevice::CtrlBound& b) { auto c = b.center(); return tap(c.x, c.y); }
+
+    InputInjector& longPress(int x, int y, int ms = 800) { return tap(x, y, ms); }
+
+    InputInjector& swipe(int x1, int y1, int x2, int y2, int ms = 300)
+    {
+        Op o;
+        o.type = Op::Swipe;
+        o.x1 = x1, o.y1 = y1, o.x2 = x2, o.y2 = y2, o.ms = qMax(ms, 1);
+        ops.push_back(o);
+        return *this;
+    }
+
+    // 按键码或名称，如 4 或 KEYCODE_BACK
+    InputInjector& key(const QString& code)
+    {
+        Op o;
+        o.type = Op::Key;
+        o.text = code;
+        ops.push_back(o);
+        return *this;
+    }
+
+    InputInjector& key(int code) { return key(QString::number(code)); }
+
+    InputInjector& text(const QString& s)
+    {
+        Op o;
+        o.type = Op::Text;
+        o.text = s;
+        ops.push_back(o);
+        return *this;
+    }
+
+    InputInjector& wait(int ms)
+    {
+        Op o;
+        o.type = Op::Wait;
+        o.ms = ms;
+        ops.push_back(o);
+        return *this;
+    }
+
+    int size() const { return ops.size(); }
+    void clear() { ops.clear(); }
+
+    // 执行已添加的全部操作，执行后清空；取消或shell命令失败时返回false
+    bool run(const CancelToken& token = CancelToken())
+    {
+        auto list = ops;
+        ops.clear();
+        // 只有按键和文字时不必探测触摸屏和屏幕方向
+        bool pointer = std::any_of(list.begin(), list.end(), [](const Op& o) { return o.type == Op::Tap || o.type == Op::Swipe; });
+        Touch t;
+        bool canRaw = pointer && touch(t) && orientation() >= 0 && openRaw(t);
+        bool ok = true;
+
+        for (int i = 0; i < list.size() && !token.cancelled(); )
+        {
+            // 写触摸屏失败时连接已关闭，余下的点击和滑动改用input命令
+            bool raw = canRaw && sock.isOpen();
+            auto& o = list[i];
+            if (o.type == Op::Wait) sleep(o.ms, token), ++i;
+            else if (raw && o.type == Op::Tap) { if (rawTap(t, o, token)) ++i; }
+            else if (raw && o.type == Op::Swipe) { if (rawSwipe(t, o, token)) ++i; }
+            else
+            {
+                // 连续的非原始事件操作合并成一条命令
+                QStringList cmds;
+                for (; i < list.size() && !(raw && (list[i].type == Op::Tap || list[i].type == Op::Swipe)); ++i)
+                    append(cmds, list[i]);
+                ok = dev->shell({ cmds.join(" && ") }).succeeded() && ok;
+            }
+        }
+        return ok && !token.cancelled();
+    }
+
+    // 转换成 input text 可接受的形式: 空格为%s，shell特殊字符由调用处的单引号处理
+    static QString escapeText(QString s)
+    {
+        return s.replace(' ', "%s");
+    }
+
+private:
+    struct Op
+    {
+        enum { Tap, Swipe, Key, Text, Wait } type;
+        int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+        int ms = 0;
+        QString text;
+    };
+
+    // 触摸屏信息，每台设备探测一次
+    struct Touch
+    {
+        QString path;           // /dev/input/eventN，空表示不可用
+        int maxX = 0, maxY = 0;
+        int width = 0, height = 0;  // 自然方向的屏幕分辨率
+        bool slot = false;      // 多点触控协议B
+        bool pressure = false;
+        bool major = false;
+        bool btnTouch = false;
+        int eventSize = 24;     // struct input_event，32位系统为16
+    };
+
+    enum
+    {
+        EV_SYN = 0, EV_KEY = 1, EV_ABS = 3,
+        SYN_REPORT = 0, BTN_TOUCH = 0x14a,
+        ABS_MT_SLOT = 0x2f, ABS_MT_TOUCH_MAJOR = 0x30, ABS_MT_POSITION_X = 0x35, ABS_MT_POSITION_Y = 0x36,
+        ABS_MT_TRACKING_ID = 0x39, ABS_MT_PRESSURE = 0x3a,
+        SwipeStep = 8,          // 滑动时两次移动的间隔(毫秒)
+    };
+
+    void append(QStringList& cmds, const Op& o)
+    {
+        switch (o.type)
+        {
+        case Op::Tap:
+            if (o.ms > 100)
+                cmds.push_back(QString("input swipe %1 %2 %1 %2 %3").arg(o.x1).arg(o.y1).arg(o.ms));
+            else cmds.push_back(QString("input tap %1 %2").arg(o.x1).arg(o.y1));
+            break;
+        case Op::Swipe:
+            cmds.push_back(QString("input swipe %1 %2 %3 %4 %5").arg(o.x1).arg(o.y1).arg(o.x2).arg(o.y2).arg(o.ms));
+            break;
+        case Op::Key:
+            // input keyevent 一次可以发多个按键
+            if (cmds.size() && cmds.last().startsWith("input keyevent ")) cmds.last() += ' ' + o.text;
+            else cmds.push_back("input keyevent " + o.text);
+            break;
+        case Op::Text:
+            cmds.push_back("input text " + AdbDevice::quote(escapeText(o.text)));
+            break;
+        case Op::Wait:
+            cmds.push_back(QString("sleep %1").arg(o.ms / 1000.0, 0, 'f', 3));
+            break;
+        }
+    }
+
+    bool touch(Touch& t)
+    {
+        static QMutex lock;
+        static QHash<QString, Touch> cache;
+        {
+            QMutexLocker l(&lock);
+            auto it = cache.constFind(dev->name);
+            if (it != cache.cend())
+            {
+                t = *it;
+                return t.path.size();
+            }
+        }
+
+        t = probe();
+        QMutexLocker l(&lock);
+        cache.insert(dev->name, t);
+        return t.path.size();
+    }
+
+    // getevent -p 列出各设备支持的事件，选第一个有多点触控坐标的
+    //  add device 2: /dev/input/event2
+    //    events:
+    //      KEY (0001): 014a
+    //      ABS (0003): 0035  : value 0, min 0, max 1079, fuzz 0, flat 0, resolution 0
+    Touch probe()
+    {
+        Touch t;
+        auto r = dev->shellBatch({ "getevent -p", "wm size", "getprop ro.product.cpu.abi" });
+        if (r.size() < 3) return t;
+
+        Touch cur;
+        bool inAbs = false, inKey = false;
+        auto done = [&] {
+            if (t.path.isEmpty() && cur.maxX > 0 && cur.maxY > 0) t = cur;
+        };
+        for (auto line : r[0].lineViews())
+        {
+            LineView p(line);
+            auto w = p.next();
+            if (w == "add")
+            {
+                done();
+                cur = Touch();
+                inAbs = inKey = false;
+                p.next(), p.next();
+                cur.path = p.rest().toString();
+                continue;
+            }
+
+            // 分类行 "ABS (0003): 0035 ..."，其余行是上一类的续行
+            LineView q = p;
+            auto type = q.next();
+            if (type.startsWith('(') && type.size() && type[type.size() - 1] == ':')
+            {
+                inKey = w == "KEY";
+                inAbs = w == "ABS";
+                p = q;
+                w = p.next();
+            }
+            else if (w.size() && w[w.size() - 1] == ':') inAbs = inKey = false;
+
+            if (inKey)
+            {
+                for (; !w.isEmpty(); w = p.next())
+                    if (w.toLongLong(nullptr, 16) == BTN_TOUCH) cur.btnTouch = true;
+            }
+            else if (inAbs && !w.isEmpty())
+            {
+                int code = int(w.toLongLong(nullptr, 16));
+                int max = 0;
+                for (auto v = p.next(); !v.isEmpty(); v = p.next())
+                {
+                    if (v != "max") continue;
+                    auto n = p.next();
+                    if (n.size() && n[n.size() - 1] == ',') n = n.mid(0, n.size() - 1);
+                    max = int(n.toLongLong());
+                }
+                if (code == ABS_MT_POSITION_X) cur.maxX = max;
+                else if (code == ABS_MT_POSITION_Y) cur.maxY = max;
+                else if (code == ABS_MT_SLOT) cur.slot = true;
+                else if (code == ABS_MT_PRESSURE) cur.pressure = true;
+                else if (code == ABS_MT_TOUCH_MAJOR) cur.major = true;
+            }
+        }
+        done();
+        // shell用户通常属于input组，个别设备不允许写
+        if (t.path.isEmpty() || !dev->shell({ "test", "-w", AdbDevice::quote(t.path), "&&", "echo", "ok" }).contains("ok")) return Touch();
+
+        // Physical size: 1080x2340
+        // Override size: 720x1560    设置过分辨率时触摸屏对应的是后者
+        QRegExp size(R"((\d+)x(\d+))");
+        QString wm = r[1];
+        if (wm.indexOf(size, qMax(0, wm.indexOf("Override size"))) < 0) return Touch();
+        t.width = size.cap(1).toInt();
+        t.height = size.cap(2).toInt();
+        t.eventSize = QString(r[2]).contains("64") ? 24 : 16;
+        return t;
+    }
+
+    // 屏幕当前方向 0~3，每次逆时针转90度；可能随时改变，隔一会儿重新读取，读不到时为-1
+    int orientation()
+    {
+        if (!orientationAge.isValid() || orientationAge.elapsed() > 2000)
+        {
+            QRegExp re(R"(SurfaceOrientation:\s*(\d))");
+            auto r = dev->shell({ "dumpsys", "input", "|", "grep", "SurfaceOrientation" });
+            rotation = QString(r).indexOf(re) >= 0 ? re.cap(1).toInt() : -1;
+            orientationAge.start();
+        }
+        return rotation;
+    }
+
+    bool openRaw(const Touch& t)
+    {
+        if (sock.isOpen()) return true;
+        return AdbClient::open(sock, dev->name, "exec:cat > " + t.path.toUtf8() + " 2>/dev/null");
+    }
+
+    void event(QByteArray& buf, int eventSize, int type, int code, int value)
+    {
+        // 时间字段由内核填写
+        int at = buf.size();
+        buf.append(eventSize, '\0');
+        auto p = buf.data() + at + eventSize - 8;
+        qToLittleEndian<quint16>(quint16(type), p);
+        qToLittleEndian<quint16>(quint16(code), p + 2);
+        qToLittleEndian<qint32>(value, p + 4);
+    }
+
+    // 屏幕坐标(随当前方向)先转回自然方向，再换算成触摸屏坐标，与InputReader中的旋转互逆
+    void position(QByteArray& buf, const Touch& t, int x, int y)
+    {
+        int nx = x, ny = y;
+        switch (rotation)
+        {
+        case 1: nx = t.width - 1 - y, ny = x; break;
+        case 2: nx = t.width - 1 - x, ny = t.height - 1 - y; break;
+        case 3: nx = y, ny = t.height - 1 - x; break;
+        }
+        event(buf, t.eventSize, EV_ABS, ABS_MT_POSITION_X, int(qint64(nx) * (t.maxX + 1) / qMax(1, t.width)));
+        event(buf, t.eventSize, EV_ABS, ABS_MT_POSITION_Y, int(qint64(ny) * (t.maxY + 1) / qMax(1, t.height)));
+    }
+
+    // 每一组事件以SYN_REPORT结束，整组一次写出，避免被拆开
+    bool down(const Touch& t, int x, int y)
+    {
+        QByteArray buf;
+        if (t.slot) event(buf, t.eventSize, EV_ABS, ABS_MT_SLOT, 0);
+        event(buf, t.eventSize, EV_ABS, ABS_MT_TRACKING_ID, ++trackingId & 0xffff);
+        position(buf, t, x, y);
+        if (t.major) event(buf, t.eventSize, EV_ABS, ABS_MT_TOUCH_MAJOR, 5);
+        if (t.pressure) event(buf, t.eventSize, EV_ABS, ABS_MT_PRESSURE, 50);
+        if (t.btnTouch) event(buf, t.eventSize, EV_KEY, BTN_TOUCH, 1);
+        event(buf, t.eventSize, EV_SYN, SYN_REPORT, 0);
+        return write(buf);
+    }
+
+    void move(const Touch& t, int x, int y)
+    {
+        QByteArray buf;
+        position(buf, t, x, y);
+        event(buf, t.eventSize, EV_SYN, SYN_REPORT, 0);
+        write(buf);
+    }
+
+    void up(const Touch& t)
+    {
+        QByteArray buf;
+        event(buf, t.eventSize, EV_ABS, ABS_MT_TRACKING_ID, -1);
+        if (t.btnTouch) event(buf, t.eventSize, EV_KEY, BTN_TOUCH, 0);
+        event(buf, t.eventSize, EV_SYN, SYN_REPORT, 0);
+        write(buf);
+    }
+
+    // 连接断开后关闭，下次run时重新连接
+    bool write(const QByteArray& buf)
+    {
+        if (sock.write(buf)) return true;
+        sock.close();
+        return false;
+    }
+
+    // 按下的事件没能写出时返回false，由调用者改用input命令
+    bool rawTap(const Touch& t, const Op& o, const CancelToken& token)
+    {
+        if (!down(t, o.x1, o.y1)) return false;
+        sleep(o.ms, token);
+        up(t);
+        return true;
+    }
+
+    bool rawSwipe(const Touch& t, const Op& o, const CancelToken& token)
+    {
+        if (!down(t, o.x1, o.y1)) return false;
+        int steps = qMax(2, o.ms / SwipeStep);
+        for (int i = 1; i <= steps && !token.cancelled(); ++i)
+        {
+            QThread::msleep(ulong(o.ms / steps));
+            move(t, o.x1 + (o.x2 - o.x1) * i / steps, o.y1 + (o.y2 - o.y1) * i / steps);
+        }
+        up(t);
+        return true;
+    }
+
+    static void sleep(int ms, const CancelToken& token)
+    {
+        for (; ms > 0 && !token.cancelled(); ms -= 50)
+            QThread::msleep(ulong(qMin(ms, 50)));
+    }
+
+    AdbDevice *dev;
+    QVector<Op> ops;
+    AdbSocket sock;         // 写触摸屏的连接，多次run之间复用
+    int trackingId = 0;
+    int rotation = -1;
+    QElapsedTimer orientationAge;
+};
+
+inline bool AdbDevice::inject(const std::function<void(InputInjector&)>& build, const CancelToken& token)
+{
+    QMutexLocker lock(&injectLock);
+    if (!injector) injector.reset(new InputInjector(this));
+    injector->clear();
+    build(*injector);
+    return injector->run(token);
+}
+
+inline bool AdbDevice::tap(const EmuPoint& p)
+{
+    return inject([&](InputInjector& in) { in.tap(p.x, p.y); });
+}
@@ -0,0 +1,461 @@
+#pragma once
+
+#include <QAbstractItemModel>
+#include <QAbstractTableModel>
+#include <QIcon>
+#include <QMultiHash>
+#include <QSet>
+#include <functional>
+#include <algorithm>
+
+#include "AdbDevice.h"
+#include "PsSnapshot.h"
+#include "FilterIndex.h"
+
+// 容量显示，输入单位为KB
+inline QString storageSize(float size)
+{
+    const char *units[] = { "KB", "MB", "GB", "TB" };
+    int i = 0;
+    while (size >= 1024 && i < 3) size /= 1024, ++i;
+    // KB 取整，更大的单位保留两位小数，避免 'g' 格式输出 5e+02
+    return QString::number(size, 'f', i ? 2 : 0).append(' ').append(units[i]);
+}
+
+// 字符串驻留池，相同内容只保存一份
+class StringPool
+{
+public:
+    int intern(const ByteView& v)
+    {
+        uint h = qHashBits(v.p, size_t(v.n));
+        for (auto it = index.constFind(h); it != index.cend() && it.key() == h; ++it)
+            if (bytes(*it) == v) return *it;
+
+        int id = strs.size();
+        raw.push_back(v.toByteArray());
+        strs.push_back(v.toString());
+        index.insert(h, id);
+        return id;
+    }
+
+    const QString& str(int id) const { return strs[id]; }
+
+    ByteView bytes(int id) const { return ByteView(raw[id].constData(), raw[id].size()); }
+
+    int size() const { return strs.size(); }
+
+    void clear()
+    {
+        raw.clear();
+        strs.clear();
+        index.clear();
+    }
+
+private:
+    QVector<QByteArray> raw;
+    QVector<QString> strs;
+    QMultiHash<uint, int> index;
+};
+
+// 列式存储的表格模型
+// 单元格只记录在原始输出中的位置(重复多的列记录驻留池id)，显示时才转换成QString，
+// 每行只占 列数 x 8 字节，没有逐个单元格的堆分配
+class ColumnTableModel : public QAbstractTableModel, public FilterSource
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<QString(const ByteView&)> Formatter;
+
+    ColumnTableModel(const QStringList& headers, QObject *parent = nullptr)
+        : QAbstractTableModel(parent), headers(headers), cols(headers.size()) {}
+
+    // 该列重复值多，驻留保存
+    void setInterned(int col, bool on = true) { cols[col].interned = on; }
+
+    // 显示格式，numeric为true时按数值排序
+    void setFormatter(int col, const Formatter& fmt, bool numeric = false)
+    {
+        cols[col].fmt = fmt;
+        cols[col].numeric = numeric;
+    }
+
+    // 第0列的图标，按appendRow时的kind选择
+    void setIcons(const QVector<QIcon>& icons) { this->icons = icons; }
+
+    // 开始替换全部数据，之后appendRow的ByteView必须指向data
+    void beginReset(const ShellResult& data)
+    {
+        beginResetModel();
+        buf = data;
+        for (auto& c : cols) c.cells.clear();
+        kinds.clear();
+        perm.clear();
+        pool.clear();
+    }
+
+    // cells个数与列数相同
+    void appendRow(const ByteView *cells, quint8 kind = 0)
+    {
+        for (int i = 0; i < cols.size(); ++i)
+        {
+            auto& c = cols[i];
+            auto& v = cells[i];
+            if (c.interned) c.cells.push_back(Cell{ quint32(pool.intern(v)), 0 });
+            else c.cells.push_back(Cell{ quint32(v.p ? v.p - buf.constData() : 0), quint32(v.n) });
+        }
+        kinds.push_back(kind);
+        perm.push_back(perm.size());
+    }
+
+    void endReset()
+    {
+        if (sortCol >= 0) sortRows();
+        endResetModel();
+    }
+
+    void clear()
+    {
+        beginReset(ShellResult());
+        endReset();
+    }
+
+    // 按显示顺序的行取原始数据
+    ByteView bytes(int row, int col) const
+    {
+        auto& c = cols[col];
+        auto& cell = c.cells[perm[row]];
+        if (c.interned) return pool.bytes(cell.off);
+        return ByteView(buf.constData() + cell.off, cell.len);
+    }
+
+    // appendRow时指定的行类型
+    quint8 kind(int row) const { return kinds[perm[row]]; }
+
+    QString text(int row, int col) const
+    {
+        auto& c = cols[col];
+        if (c.fmt) return c.fmt(bytes(row, col));
+        if (c.interned) return pool.str(c.cells[perm[row]].off);
+        return bytes(row, col).toString();
+    }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : perm.size();
+    }
+
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : cols.size();
+    }
+
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override
+    {
+        if (!index.isValid()) return QVariant();
+        if (role == Qt::DisplayRole || role == Qt::EditRole)
+            return text(index.row(), index.column());
+        if (role == Qt::DecorationRole && index.column() == 0)
+        {
+            int k = kinds[perm[index.row()]];
+            if (k < icons.size()) return icons[k];
+        }
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        if (orientation == Qt::Horizontal && role == Qt::DisplayRole && section < headers.size())
+            return headers[section];
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override
+    {
+        sortCol = column;
+        sortOrder = order;
+
+        emit layoutAboutToBeChanged();
+        auto from = persistentIndexList();
+        QVector<int> rows;
+        for (auto& i : from) rows.push_back(perm[i.row()]);
+
+        sortRows();
+
+        QVector<int> pos(perm.size());
+        for (int i = 0; i < perm.size(); ++i) pos[perm[i]] = i;
+        QModelIndexList to;
+        for (int i = 0; i < from.size(); ++i)
+            to.push_back(index(pos[rows[i]], from[i].column()));
+        changePersistentIndexList(from, to);
+        emit layoutChanged();
+    }
+
+    // 列数据和原始输出都是隐式共享的，拷贝一份交给过滤线程
+    FilterRows filterRows(const QModelIndexList& rows) const override
+    {
+        QVector<int> stored;
+        for (auto& i : rows) stored.push_back(perm[i.row()]);
+        auto cols = this->cols;
+        auto buf = this->buf;
+        auto pool = this->pool;
+        return [cols, buf, pool, stored](QVector<QVector<QByteArray>>& out) {
+            for (int r : stored)
+            {
+                QVector<QByteArray> cells(cols.size());
+                for (int c = 0; c < cols.size(); ++c)
+                {
+                    auto& col = cols[c];
+                    auto& cell = col.cells[r];
+                    auto v = col.interned ? pool.bytes(cell.off) : ByteView(buf.constData() + cell.off, cell.len);
+                    cells[c] = (col.fmt ? col.fmt(v) : v.toString()).toLower().toUtf8();
+                }
+                out.push_back(cells);
+            }
+        };
+    }
+
+private:
+    struct Cell
+    {
+        quint32 off;    // 在buf中的偏移，驻留列为池id
+        quint32 len;
+    };
+
+    struct Column
+    {
+        QVector<Cell> cells;    // 按存储顺序
+        bool interned = false;
+        bool numeric = false;
+        Formatter fmt;
+    };
+
+    ByteView storedBytes(int row, int col) const
+    {
+        auto& c = cols[col];
+        auto& cell = c.cells[row];
+        if (c.interned) return pool.bytes(cell.off);
+        return ByteView(buf.constData() + cell.off, cell.len);
+    }
+
+    void sortRows()
+    {
+        if (sortCol < 0 || sortCol >= cols.size()) return;
+        bool numeric = cols[sortCol].numeric;
+        auto less = [this, numeric](int a, int b) {
+            auto x = storedBytes(a, sortCol);
+            auto y = storedBytes(b, sortCol);
+            if (numeric) return x.toLongLong() < y.toLongLong();
+            int r = memcmp(x.p, y.p, qMin(x.n, y.n));
+            return r < 0 || (r == 0 && x.n < y.n);
+        };
+        if (sortOrder == Qt::AscendingOrder)
+            std::stable_sort(perm.begin(), perm.end(), less);
+        else
+            std::stable_sort(perm.begin(), perm.end(), [&less](int a, int b) { return less(b, a); });
+    }
+
+    QStringList headers;
+    QVector<Column> cols;
+    QVector<quint8> kinds;      // 行类型，用于选择图标
+    QVector<int> perm;          // 显示顺序 -> 存储顺序
+    QVector<QIcon> icons;
+    ShellResult buf;            // 原始输出
+    StringPool pool;
+    int sortCol = -1;
+    Qt::SortOrder sortOrder = Qt::AscendingOrder;
+};
+
+// 进程树模型，按PsSnapshot的增量插入/移动/删除节点，显示内容直接取自快照
+class ProcessModel : public QAbstractItemModel, public FilterSource
+{
+    Q_OBJECT
+
+public:
+    enum { ColName, ColPid, ColUser, ColMem, ColCmd, ColumnCount };
+
+    ProcessModel(QObject *parent = nullptr): QAbstractItemModel(parent) {}
+    ~ProcessModel() { qDeleteAll(nodes); }
+
+    const PsSnapshot& snapshot() const { return snap; }
+
+    int pid(const QModelIndex& i) const { return i.isValid() ? node(i)->pid : 0; }
+
+    QModelIndex indexOf(int pid) const { return indexOf(nodes.value(pid)); }
+
+    void clear()
+    {
+        beginResetModel();
+        qDeleteAll(nodes);
+        nodes.clear();
+        root.children.clear();
+        snap = PsSnapshot();
+        endResetModel();
+    }
+
+    void apply(const PsSnapshot& now)
+    {
+        auto& d = now.diff;
+        snap = now;
+
+        // 新进程: 父进程也是新进程的先直接挂好，整棵子树随最上层节点一次插入
+        QSet<int> added;
+        for (int pid : d.added)
+        {
+            added.insert(pid);
+            nodes.insert(pid, new Node(pid));
+        }
+        QList<Node*> tops;
+        for (int pid : d.added)
+        {
+            auto n = nodes.value(pid);
+            int ppid = now.procs.value(pid).ppid;
+            if (ppid != pid && added.contains(ppid))
+            {
+                n->parent = nodes.value(ppid);
+                n->parent->children.push_back(n);
+            }
+            else tops.push_back(n);
+        }
+        for (auto n : tops)
+        {
+            auto p = parentOf(now.procs.value(n->pid).ppid);
+            beginInsertRows(indexOf(p), p->children.size(), p->children.size());
+            n->parent = p;
+            p->children.push_back(n);
+            endInsertRows();
+        }
+
+        // 父进程变化
+        for (int pid : d.moved)
+            move(nodes.value(pid), parentOf(now.procs.value(pid).ppid));
+
+        // 退出的进程，剩下的子进程移到顶层
+        for (int pid : d.removed)
+        {
+            auto n = nodes.take(pid);
+            while (!n->children.isEmpty()) move(n->children.last(), &root);
+            int r = row(n);
+            beginRemoveRows(indexOf(n->parent), r, r);
+            n->parent->children.remove(r);
+            endRemoveRows();
+            delete n;
+        }
+
+        for (int pid : d.changed)
+        {
+            auto i = indexOf(nodes.value(pid));
+            if (i.isValid()) emit dataChanged(i, i.sibling(i.row(), ColumnCount - 1));
+        }
+    }
+
+    QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override
+    {
+        auto p = parent.isValid() ? node(parent) : &root;
+        if (row < 0 || row >= p->children.size() || column < 0 || column >= ColumnCount)
+            return QModelIndex();
+        return createIndex(row, column, p->children[row]);
+    }
+
+    QModelIndex parent(const QModelIndex& child) const override
+    {
+        if (!child.isValid()) return QModelIndex();
+        return indexOf(node(child)->parent);
+    }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        if (parent.column() > 0) return 0;
+        return (parent.isValid() ? node(parent) : &root)->children.size();
+    }
+
+    int columnCount(const QModelIndex& = QModelIndex()) const override { return ColumnCount; }
+
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override
+    {
+        if (!index.isValid() || role != Qt::DisplayRole) return QVariant();
+        auto it = snap.procs.constFind(node(index)->pid);
+        if (it == snap.procs.cend()) return QVariant();
+
+        switch (index.column())
+        {
+        case ColName: return it->name.toString();
+        case ColPid: return it->pid;
+        case ColUser: return it->user.toString();
+        case ColMem: return storageSize(it->vsz.toLongLong());
+        case ColCmd: return it->cmd.toString();
+        }
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        static const char *titles[] = { "进程", "PID", "用户", "内存", "命令行" };
+        if (orientation == Qt::Horizontal && role == Qt::DisplayRole && section < ColumnCount)
+            return QString(titles[section]);
+        return QAbstractItemModel::headerData(section, orientation, role);
+    }
+
+    // 快照的原始输出是隐式共享的，拷贝后在过滤线程上生成与data()相同的文本
+    FilterRows filterRows(const QModelIndexList& rows) const override
+    {
+        QVector<int> pids;
+        for (auto& i : rows) pids.push_back(pid(i));
+        auto snap = this->snap;
+        return [snap, pids](QVector<QVector<QByteArray>>& out) {
+            for (int pid : pids)
+            {
+                QVector<QByteArray> cells(ColumnCount);
+                auto it = snap.procs.constFind(pid);
+                if (it != snap.procs.cend())
+                {
+                    cells[ColName] = it->name.toString().toLower().toUtf8();
+                    cells[ColPid] = QByteArray::number(it->pid);
+                    cells[ColUser] = it->user.toString().toLower().toUtf8();
+                    cells[ColMem] = storageSize(it->vsz.toLongLong()).toLower().toUtf8();
+                    cells[ColCmd] = it->cmd.toString().toLower().toUtf8();
+                }
+                out.push_back(cells);
+            }
+        };
+    }
+
+private:
+    struct Node
+    {
+        Node(int pid = 0): pid(pid) {}
+
+        int pid;
+        Node *parent = nullptr;
+        QVector<Node*> children;
+    };
+
+    Node *node(const QModelIndex& i) const { return (Node*)i.internalPointer(); }
+
+    // 父进程节点，不在列表中时为根
+    Node *parentOf(int ppid) { auto p = nodes.value(ppid); return p ? p : &root; }
+
+    int row(const Node *n) const { return n->parent->children.indexOf(const_cast<Node*>(n)); }
+
+    QModelIndex indexOf(const Node *n) const
+    {
+        if (!n || n == &root || !n->parent) return QModelIndex();
+        return createIndex(row(n), 0, const_cast<Node*>(n));
+    }
+
+    void move(Node *n, Node *p)
+    {
+        if (!n || n->parent == p) return;
+        int r = row(n);
+        if (!beginMoveRows(indexOf(n->parent), r, r, indexOf(p), p->children.size())) return;
+        n->parent->children.remove(r);
+        n->parent = p;
+        p->children.push_back(n);
+        endMoveRows();
+    }
+
+    mutable Node root;
+    QHash<int, Node*> nodes;
+    PsSnapshot snap;
+};
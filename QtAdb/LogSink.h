@@ -0,0 +1,199 @@
+#pragma once
+
+#include <QObject>
+#include <QPlainTextEdit>
+#include <QScrollBar>
+#include <QTimer>
+#include <QFile>
+#include <QDir>
+#include <QMenu>
+#include <QDialog>
+#include <QListView>
+#include <QBoxLayout>
+#include <QCoreApplication>
+#include <QAbstractListModel>
+
+#include "FastScan.h"
+
+// 按行显示映射到内存的文件，只建行首偏移的索引，文本在显示时才转换
+class MappedLinesModel : public QAbstractListModel
+{
+public:
+    MappedLinesModel(const QString& path, QObject *parent): QAbstractListModel(parent), file(path)
+    {
+        if (!file.open(QIODevice::ReadOnly) || file.size() == 0) return;
+        data_ = (const char*)file.map(0, file.size());
+        if (!data_) return;
+        size = file.size();
+
+        starts.push_back(0);
+        const qint64 step = 256 * 1024 * 1024;
+        for (qint64 b = 0; b < size; b += step)
+        {
+            int n = int(qMin(step, size - b));
+            FastScan::forEachNewline(data_ + b, n, [&](int i) {
+                if (b + i + 1 < size) starts.push_back(b + i + 1);
+            });
+        }
+    }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : starts.size();
+    }
+
+    QVariant data(const QModelIndex& idx, int role) const override
+    {
+        if (role != Qt::DisplayRole) return QVariant();
+        qint64 b = starts[idx.row()];
+        qint64 e = idx.row() + 1 < starts.size() ? starts[idx.row() + 1] - 1 : size;
+        if (e > b && data_[e - 1] == '\r') --e;
+        return QString::fromUtf8(data_ + b, int(qMin<qint64>(e - b, 4096)));
+    }
+
+private:
+    QFile file;
+    const char *data_ = nullptr;
+    qint64 size = 0;
+    QVector<qint64> starts;
+};
+
+// 日志输出
+// 追加的文本先缓存，每帧合并成一次appendPlainText；显示的行数有上限，超出时丢弃最早的；
+// 很大的输出(如所有应用的dumpsys)写入临时文件，日志区只显示开头几行，完整内容在右键菜单中查看
+class LogSink : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum
+    {
+        FrameMs = 16,
+        SpillBytes = 256 * 1024,    // 超过此大小的单次输出写入文件
+        PreviewLines = 40,
+    };
+
+    LogSink(QPlainTextEdit *edit, int maxLines = 20000): QObject(edit), edit(edit)
+    {
+        setMaxLines(maxLines);
+        edit->setReadOnly(true);
+        edit->setUndoRedoEnabled(false);
+        edit->setContextMenuPolicy(Qt::CustomContextMenu);
+        connect(edit, &QWidget::customContextMenuRequested, this, &LogSink::showMenu);
+
+        timer.setSingleShot(true);
+        timer.setInterval(FrameMs);
+        connect(&timer, &QTimer::timeout, this, &LogSink::flush);
+    }
+
+    ~LogSink()
+    {
+        for (auto& s : spills) QFile::remove(s);
+    }
+
+    // 显示的最大行数
+    void setMaxLines(int n)
+    {
+        maxLines = n;
+        edit->setMaximumBlockCount(n);
+    }
+
+    void append(const QString& text)
+    {
+        if (text.size() > SpillBytes) return spill(text.toUtf8());
+        pending.push_back(text);
+        pendingLines += text.count('\n') + 1;
+        // 一帧内追加的超过上限时，最早的反正也会被裁掉
+        while (pendingLines > maxLines && pending.size() > 1)
+            pendingLines -= pending.takeFirst().count('\n') + 1;
+        if (!timer.isActive()) timer.start();
+    }
+
+    // 命令的原始输出，大的不必先转换成QString
+    void append(const QByteArray& utf8)
+    {
+        if (utf8.size() > SpillBytes) spill(utf8);
+        else append(QString::fromUtf8(utf8));
+    }
+
+    void clear()
+    {
+        pending.clear();
+        pendingLines = 0;
+        edit->clear();
+    }
+
+    // 打开第i个写入文件的输出，-1为最近一个
+    void showSpill(int i = -1)
+    {
+        if (spills.isEmpty()) return;
+        if (i < 0 || i >= spills.size()) i = spills.size() - 1;
+
+        auto dlg = new QDialog(edit->window());
+        dlg->setAttribute(Qt::WA_DeleteOnClose);
+        dlg->setWindowTitle(spills[i]);
+        dlg->resize(900, 600);
+        auto view = new QListView(dlg);
+        view->setUniformItemSizes(true);
+        view->setFont(edit->font());
+        view->setModel(new MappedLinesModel(spills[i], view));
+        auto layout = new QVBoxLayout(dlg);
+        layout->setContentsMargins(0, 0, 0, 0);
+        layout->addWidget(view);
+        dlg->show();
+    }
+
+private:
+    void flush()
+    {
+        if (pending.isEmpty()) return;
+        auto text = pending.join('\n');
+        pending.clear();
+        pendingLines = 0;
+        edit->appendPlainText(text);
+    }
+
+    void spill(const QByteArray& data)
+    {
+        auto path = QDir::temp().filePath(QString("qtadb-%1-%2.txt")
+            .arg(QCoreApplication::applicationPid()).arg(spills.size() + 1));
+        QFile f(path);
+        if (!f.open(QIODevice::WriteOnly) || f.write(data) != data.size())
+        {
+            append(QString::fromUtf8(data.left(SpillBytes)));
+            append(QString("[输出过大，写入 %1 失败，只显示开头部分]").arg(path));
+            return;
+        }
+        spills.push_back(path);
+
+        // 只预览开头几行
+        int end = -1;
+        for (int i = 0; i < PreviewLines; ++i)
+        {
+            int n = data.indexOf('\n', end + 1);
+            if (n < 0) break;
+            end = n;
+        }
+        append(QString::fromUtf8(data.left(end < 0 ? 4096 : qMin(end, 64 * 1024))));
+        append(QString("[输出 %1 KB，完整内容已写入 %2，右键“查看完整输出”]")
+            .arg(data.size() / 1024).arg(path));
+    }
+
+    void showMenu(const QPoint& pos)
+    {
+        auto menu = edit->createStandardContextMenu();
+        menu->addSeparator();
+        auto view = menu->addAction("查看完整输出", this, [this] { showSpill(); });
+        view->setEnabled(!spills.isEmpty());
+        menu->addAction("清空", this, &LogSink::clear);
+        menu->exec(edit->mapToGlobal(pos));
+        delete menu;
+    }
+
+    QPlainTextEdit *edit;
+    QTimer timer;
+    QStringList pending;
+    int pendingLines = 0;
+    int maxLines = 0;
+    QStringList spills;     // 写入的临时文件，退出时删除
+};
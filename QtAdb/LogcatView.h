@@ -0,0 +1,563 @@
+#pragma once
+
+#include <QWidget>
+#include <QTableView>
+#include <QHeaderView>
+#include <QScrollBar>
+#include <QLineEdit>
+#include <QComboBox>
+#include <QPushButton>
+#include <QLabel>
+#include <QBoxLayout>
+#include <QTimer>
+#include <QDateTime>
+#include <QRegularExpression>
+#include <QColor>
+#include <QAbstractTableModel>
+#include <algorithm>
+
+#include "AdbDevice.h"
+#include "FilterIndex.h"
+
+// logcat 日志存储
+// 条目是定长结构，放在固定容量的环形数组中，按序号(只增不减)访问；消息文本放在固定大小的环形字节区，
+// 标签驻留成id。标签、pid、级别建有序号列表，过滤时先取最短的列表，不必扫描全部条目
+class LogStore
+{
+public:
+    struct Entry
+    {
+        qint64 time = 0;        // 毫秒
+        qint64 text = 0;        // 消息在文本区中的绝对位置
+        qint32 pid = 0;
+        qint32 tid = 0;
+        qint32 tag = 0;
+        qint32 len = 0;
+        quint8 level = 0;       // 2-7: V D I W E F
+    };
+
+    LogStore(int capacity = 512 * 1024, int textBytes = 32 * 1024 * 1024)
+        : ring(capacity), text(textBytes, '\0') {}
+
+    qint64 first() const { return head; }
+    qint64 end() const { return tail; }
+    int size() const { return int(tail - head); }
+    const Entry& at(qint64 seq) const { return ring[int(seq % ring.size())]; }
+
+    QString tagName(int id) const { return tags[id]; }
+    int tagId(const QString& name) const { return tagIds.value(name, -1); }
+
+    QString message(const Entry& e) const
+    {
+        QByteArray b(e.len, Qt::Uninitialized);
+        int pos = int(e.text % text.size()), n = qMin(e.len, text.size() - pos);
+        memcpy(b.data(), text.constData() + pos, n);
+        memcpy(b.data() + n, text.constData(), e.len - n);
+        return QString::fromUtf8(b);
+    }
+
+    void clear()
+    {
+        head = tail = textPos = 0;
+        byTag.clear();
+        byPid.clear();
+        for (auto& l : byLevel) l.clear();
+    }
+
+    // 添加一条，返回序号
+    qint64 append(qint64 time, int pid, int tid, int level, const ByteView& tag, ByteView msg)
+    {
+        // 过长的消息截断，避免一条挤掉大量条目
+        msg = msg.mid(0, text.size() / 16);
+        while (msg.size() && (msg[msg.size() - 1] == '\n' || msg[msg.size() - 1] == '\0')) msg = msg.mid(0, msg.size() - 1);
+
+        Entry e;
+        e.time = time, e.pid = pid, e.tid = tid, e.level = quint8(qBound(0, level, 7));
+        e.tag = intern(tag);
+        e.text = textPos, e.len = msg.size();
+
+        int pos = int(textPos % text.size()), n = qMin(msg.size(), text.size() - pos);
+        memcpy(text.data() + pos, msg.p, n);
+        memcpy(text.data(), msg.p + n, msg.size() - n);
+        textPos += msg.size();
+
+        // 条目数或文本区满时淘汰最早的
+        while (tail - head >= ring.size()) ++head;
+        while (head < tail && at(head).text < textPos - text.size()) ++head;
+
+        qint64 seq = tail++;
+        ring[int(seq % ring.size())] = e;
+        byTag[e.tag].push_back(seq);
+        byPid[e.pid].push_back(seq);
+        byLevel[e.level].push_back(seq);
+
+        if (head - trimmed > ring.size() / 4) trim();
+        return seq;
+    }
+
+    // 候选序号: 取条件对应的最短列表，没有可用的列表时返回false，需扫描全部
+    bool candidates(const QStringList& tagNames, int pid, int minLevel, QVector<qint64>& out) const
+    {
+        QVector<const QVector<qint64>*> lists;
+        qint64 best = -1;
+        auto consider = [&](const QVector<const QVector<qint64>*>& l) {
+            qint64 n = 0;
+            for (auto p : l) n += p->size();
+            if (best < 0 || n < best) best = n, lists = l;
+        };
+
+        if (tagNames.size())
+        {
+            QVector<const QVector<qint64>*> l;
+            for (auto& t : tagNames)
+            {
+                auto it = byTag.constFind(tagId(t));
+                if (it != byTag.cend()) l.push_back(&*it);
+            }
+            consider(l);
+        }
+        if (pid > 0)
+        {
+            auto it = byPid.constFind(pid);
+            consider(it == byPid.cend() ? QVector<const QVector<qint64>*>() : QVector<const QVector<qint64>*>{ &*it });
+        }
+        if (minLevel > 2)
+        {
+            QVector<const QVector<qint64>*> l;
+            for (int i = minLevel; i < 8; ++i) l.push_back(&byLevel[i]);
+            consider(l);
+        }
+        if (best < 0) return false;
+
+        out.clear();
+        for (auto p : lists)
+        {
+            auto b = std::lower_bound(p->begin(), p->end(), head);
+            for (auto it = b; it != p->end(); ++it) out.push_back(*it);
+        }
+        if (lists.size() > 1) std::sort(out.begin(), out.end());
+        return true;
+    }
+
+private:
+    int intern(const ByteView& tag)
+    {
+        auto name = QString::fromUtf8(tag.p, tag.n);
+        auto it = tagIds.constFind(name);
+        if (it != tagIds.cend()) return *it;
+        tags.push_back(name);
+        return *tagIds.insert(name, tags.size() - 1);
+    }
+
+    // 去掉各列表中已淘汰的序号
+    void trim()
+    {
+        auto cut = [this](QVector<qint64>& l) {
+            l.remove(0, int(std::lower_bound(l.begin(), l.end(), head) - l.begin()));
+        };
+        for (auto h : { &byTag, &byPid })
+        {
+            for (auto it = h->begin(); it != h->end(); )
+            {
+                cut(*it);
+                if (it->isEmpty()) it = h->erase(it);
+                else ++it;
+            }
+        }
+        for (auto& l : byLevel) cut(l);
+        trimmed = head;
+    }
+
+    QVector<Entry> ring;
+    QByteArray text;
+    qint64 head = 0, tail = 0;  // 有效序号 [head, tail)
+    qint64 textPos = 0;
+    qint64 trimmed = 0;
+
+    QVector<QString> tags;
+    QHash<QString, int> tagIds;
+    QHash<int, QVector<qint64>> byTag, byPid;
+    QVector<qint64> byLevel[8];
+};
+
+// 过滤条件
+struct LogFilter
+{
+    QStringList tags;       // 任一
+    int pid = 0;
+    int minLevel = 2;
+    QByteArray text;        // 小写，包含
+    QRegularExpression re;
+    bool regex = false;
+
+    bool isEmpty() const { return tags.isEmpty() && pid <= 0 && minLevel <= 2 && text.isEmpty() && !regex; }
+
+    bool matches(const LogStore& s, const LogStore::Entry& e) const
+    {
+        if (e.level < minLevel) return false;
+        if (pid > 0 && e.pid != pid) return false;
+        if (tags.size() && !tags.contains(s.tagName(e.tag))) return false;
+        if (regex) return re.match(s.message(e)).hasMatch();
+        if (text.size()) return s.message(e).toLower().toUtf8().contains(text);
+        return true;
+    }
+};
+
+// 过滤后的行，只存序号，数据在显示时从LogStore取
+class LogcatModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    LogcatModel(LogStore *store, QObject *parent): QAbstractTableModel(parent), store(store) {}
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : rows.size() - front;
+    }
+
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : 6;
+    }
+
+    QVariant headerData(int section, Qt::Orientation o, int role) const override
+    {
+        static const char *names[] = { "时间", "PID", "TID", "级别", "标签", "消息" };
+        if (o == Qt::Horizontal && role == Qt::DisplayRole) return QString(names[section]);
+        return QVariant();
+    }
+
+    QVariant data(const QModelIndex& idx, int role) const override
+    {
+        qint64 seq = rows[front + idx.row()];
+        if (seq < store->first()) return QVariant();
+        auto& e = store->at(seq);
+        if (role == Qt::ForegroundRole)
+        {
+            if (e.level >= 6) return QColor(200, 0, 0);
+            if (e.level == 5) return QColor(180, 110, 0);
+            if (e.level <= 3) return QColor(110, 110, 110);
+            return QVariant();
+        }
+        if (role != Qt::DisplayRole) return QVariant();
+        switch (idx.column())
+        {
+        case 0: return QDateTime::fromMSecsSinceEpoch(e.time).toString("MM-dd hh:mm:ss.zzz");
+        case 1: return e.pid;
+        case 2: return e.tid;
+        case 3: return QString(QChar("??VDIWEF"[e.level]));
+        case 4: return store->tagName(e.tag);
+        case 5: return store->message(e);
+        }
+        return QVariant();
+    }
+
+    void reset(const QVector<qint64>& list)
+    {
+        beginResetModel();
+        rows = list;
+        front = 0;
+        endResetModel();
+    }
+
+    // 先去掉已被淘汰的行，再追加新的
+    void update(const QVector<qint64>& added)
+    {
+        int gone = 0;
+        while (front + gone < rows.size() && rows[front + gone] < store->first()) ++gone;
+        if (gone)
+        {
+            beginRemoveRows(QModelIndex(), 0, gone - 1);
+            front += gone;
+            endRemoveRows();
+            // 前面空出一半以上时再整体移动
+            if (front > rows.size() / 2)
+            {
+                rows.remove(0, front);
+                front = 0;
+            }
+        }
+        if (added.size())
+        {
+            int n = rows.size() - front;
+            beginInsertRows(QModelIndex(), n, n + added.size() - 1);
+            rows += added;
+            endInsertRows();
+        }
+    }
+
+private:
+    LogStore *store;
+    QVector<qint64> rows;
+    int front = 0;
+};
+
+// logcat 面板
+// 后台线程读取 logcat -B 的二进制输出，按完整条目切分后每50ms交给界面线程一批；
+// 界面线程写入LogStore，只对新条目判断过滤条件，表格一次追加整批
+class LogcatView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    LogcatView(QWidget *parent): QWidget(parent)
+    {
+        editTag = new QLineEdit(this);
+        editTag->setPlaceholderText("标签，多个用逗号分隔");
+        editPid = new QLineEdit(this);
+        editPid->setPlaceholderText("PID");
+        editPid->setMaximumWidth(80);
+        comboLevel = new QComboBox(this);
+        comboLevel->addItems({ "Verbose", "Debug", "Info", "Warn", "Error", "Fatal" });
+        editText = new QLineEdit(this);
+        editText->setPlaceholderText("包含文本，或 /正则/");
+        auto clearButton = new QPushButton("清空", this);
+        status = new QLabel(this);
+
+        auto top = new QHBoxLayout();
+        top->addWidget(editTag, 2);
+        top->addWidget(editPid);
+        top->addWidget(comboLevel);
+        top->addWidget(editText, 3);
+        top->addWidget(clearButton);
+        top->addWidget(status);
+
+        model = new LogcatModel(&store, this);
+        table = new QTableView(this);
+        table->setModel(model);
+        table->setSelectionBehavior(QAbstractItemView::SelectRows);
+        table->setWordWrap(false);
+        table->verticalHeader()->setDefaultSectionSize(18);
+        table->verticalHeader()->hide();
+        table->horizontalHeader()->setStretchLastSection(true);
+        table->setColumnWidth(0, 130);
+        table->setColumnWidth(1, 55);
+        table->setColumnWidth(2, 55);
+        table->setColumnWidth(3, 35);
+        table->setColumnWidth(4, 160);
+
+        auto layout = new QVBoxLayout(this);
+        layout->setContentsMargins(0, 0, 0, 0);
+        layout->addLayout(top);
+        layout->addWidget(table);
+
+        // 输入停顿后再过滤
+        filterTimer.setSingleShot(true);
+        filterTimer.setInterval(200);
+        connect(&filterTimer, &QTimer::timeout, this, &LogcatView::refilter);
+        for (auto e : { editTag, editPid, editText })
+            connect(e, &QLineEdit::textChanged, &filterTimer, static_cast<void(QTimer::*)()>(&QTimer::start));
+        connect(comboLevel, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &LogcatView::refilter);
+        connect(clearButton, &QPushButton::clicked, this, &LogcatView::clear);
+
+        rateClock.start();
+    }
+
+    ~LogcatView() { stop(); }
+
+    // 开始读取某台设备的日志，已在读取时不重复启动
+    void start(AdbDevice *dev)
+    {
+        if (dev == this->dev && reader.isRunning()) return;
+        stop();
+        this->dev = dev;
+        clear();
+        if (!dev) return;
+        token = CancelToken();
+        reader = Async::run([this, dev, token = token] { read(dev, token); });
+    }
+
+    void stop()
+    {
+        token.cancel();
+        reader.waitForFinished();
+    }
+
+    // 之前已排队但还没处理的批次随之作废
+    void clear()
+    {
+        gen.fetchAndAddOrdered(1);
+        ++filterSeq;            // 进行中的后台过滤结果也作废
+        scanning = false;
+        store.clear();
+        model->reset(QVector<qint64>());
+        status->clear();
+    }
+
+private:
+    // 后台线程: 读取并按条目切分
+    //  logger_entry: len(2) hdr_size(2) pid(4) tid(4) sec(4) nsec(4) [lid(4) uid(4)] + 载荷
+    //  载荷: 级别(1) 标签\0 消息\0
+    void read(AdbDevice *dev, CancelToken token)
+    {
+        AdbSocket s;
+        // -T 1000: 先取最近的1000条，之后持续输出
+        if (!AdbClient::open(s, dev->name, "exec:logcat -B -T 1000")) return;
+        s.setBufferSize(1024 * 1024);
+
+        QByteArray buf;
+        QElapsedTimer t;
+        t.start();
+        char chunk[64 * 1024];
+        while (!token.cancelled())
+        {
+            // 最多等100ms，及时响应取消，也让攒下的数据按时交出
+            if (s.waitReadable(100))
+            {
+                int r = s.read(chunk, sizeof(chunk));
+                if (r <= 0) break;
+                buf.append(chunk, r);
+            }
+
+            if (t.elapsed() < 50 && buf.size() < 1024 * 1024) continue;
+            t.restart();
+
+            // 只交出完整的条目，剩余部分留到下次
+            int pos = 0;
+            while (buf.size() - pos >= 4)
+            {
+                int len = qFromLittleEndian<quint16>(buf.constData() + pos);
+                int hdr = qFromLittleEndian<quint16>(buf.constData() + pos + 2);
+                if (hdr == 0) hdr = 20;
+                if (buf.size() - pos < hdr + len) break;
+                pos += hdr + len;
+            }
+            if (pos == 0) continue;
+
+            auto batch = buf.left(pos);
+            buf.remove(0, pos);
+            // 发出时的代数，之后有过清空或重新启动的批次在界面线程丢弃
+            int g = gen.loadAcquire();
+            QMetaObject::invokeMethod(this, [this, batch, g] { if (g == gen.loadAcquire()) append(batch); }, Qt::QueuedConnection);
+        }
+    }
+
+    // 界面线程: 写入存储，新条目中符合条件的追加到表格
+    void append(const QByteArray& batch)
+    {
+        QVector<qint64> added;
+        auto p = batch.constData();
+        int pos = 0, count = 0;
+        while (pos + 20 <= batch.size())
+        {
+            int len = qFromLittleEndian<quint16>(p + pos);
+            int hdr = qFromLittleEndian<quint16>(p + pos + 2);
+            if (hdr == 0) hdr = 20;
+            if (pos + hdr + len > batch.size()) break;
+
+            int pid = qFromLittleEndian<qint32>(p + pos + 4);
+            int tid = qFromLittleEndian<qint32>(p + pos + 8);
+            qint64 time = qint64(qFromLittleEndian<quint32>(p + pos + 12)) * 1000
+                        + qFromLittleEndian<quint32>(p + pos + 16) / 1000000;
+
+            ByteView payload(p + pos + hdr, len);
+            pos += hdr + len;
+            if (payload.size() < 2) continue;
+
+            int level = payload[0];
+            int e = payload.indexOf('\0', 1);
+            if (e < 0) continue;
+            auto seq = store.append(time, pid, tid, level, payload.mid(1, e - 1), payload.mid(e + 1));
+            ++count;
+            // 后台过滤期间到达的条目在结果回来时一起判断
+            if (!scanning && (filter.isEmpty() || filter.matches(store, store.at(seq)))) added.push_back(seq);
+        }
+
+        // 在底部时跟随新日志
+        auto bar = table->verticalScrollBar();
+        bool follow = bar->value() >= bar->maximum() - 2;
+        model->update(added);
+        if (follow && added.size()) table->scrollToBottom();
+
+        lines += count;
+        if (rateClock.elapsed() >= 1000)
+        {
+            status->setText(QString("%1 条, %2 行/秒").arg(store.size()).arg(lines * 1000 / rateClock.elapsed()));
+            lines = 0;
+            rateClock.restart();
+        }
+    }
+
+    // 条件改变后重新过滤
+    // 文本和正则要逐条取出消息比较，条目多时要几秒，在后台对存储的快照进行；
+    // 快照与存储隐式共享，只在之后写入时复制一次
+    void refilter()
+    {
+        LogFilter f;
+        for (auto& t : editTag->text().split(',', QString::SkipEmptyParts)) f.tags.push_back(t.trimmed());
+        f.pid = editPid->text().trimmed().toInt();
+        f.minLevel = comboLevel->currentIndex() + 2;
+        auto q = FilterQuery::parse(editText->text(), QStringList());
+        f.text = q.text;
+        f.re = q.re;
+        f.regex = q.regex;
+        filter = f;
+
+        int id = ++filterSeq;
+        if (f.text.isEmpty() && !f.regex)
+        {
+            scanning = false;
+            return showRows(scan(store, f));
+        }
+
+        scanning = true;
+        LogStore snap = store;
+        qint64 end = store.end();
+        Async::then(this, Async::run([snap, f] { return scan(snap, f); }), [this, id, end](QVector<qint64> rows) {
+            if (id != filterSeq) return;
+            scanning = false;
+            // 去掉其间被淘汰的，补上快照之后到达的
+            rows.remove(0, int(std::lower_bound(rows.begin(), rows.end(), store.first()) - rows.begin()));
+            for (qint64 seq = qMax(end, store.first()); seq < store.end(); ++seq)
+                if (filter.matches(store, store.at(seq))) rows.push_back(seq);
+            showRows(rows);
+        });
+    }
+
+    void showRows(const QVector<qint64>& rows)
+    {
+        model->reset(rows);
+        table->scrollToBottom();
+    }
+
+    // 符合条件的序号，先用索引缩小范围
+    static QVector<qint64> scan(const LogStore& store, const LogFilter& filter)
+    {
+        QVector<qint64> rows;
+        if (!filter.isEmpty())
+        {
+            QVector<qint64> cand;
+            if (store.candidates(filter.tags, filter.pid, filter.minLevel, cand))
+            {
+                for (auto seq : cand)
+                    if (filter.matches(store, store.at(seq))) rows.push_back(seq);
+            }
+            else
+            {
+                for (qint64 seq = store.first(); seq < store.end(); ++seq)
+                    if (filter.matches(store, store.at(seq))) rows.push_back(seq);
+            }
+        }
+        else for (qint64 seq = store.first(); seq < store.end(); ++seq) rows.push_back(seq);
+        return rows;
+    }
+
+    AdbDevice *dev = nullptr;
+    QFuture<void> reader;
+    CancelToken token;
+    QAtomicInt gen;             // 清空时增加
+    int filterSeq = 0;          // 最近一次过滤的序号，旧的后台结果丢弃
+    bool scanning = false;      // 后台过滤中，新条目暂不加入表格
+
+    LogStore store;
+    LogFilter filter;
+    LogcatModel *model;
+    QTableView *table;
+    QLineEdit *editTag, *editPid, *editText;
+    QComboBox *comboLevel;
+    QLabel *status;
+    QTimer filterTimer;
+    QElapsedTimer rateClock;
+    qint64 lines = 0;
+};
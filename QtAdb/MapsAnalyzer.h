@@ -0,0 +1,431 @@
+#pragma once
+
+#include <QAbstractTableModel>
+#include <QElapsedTimer>
+#include <QHash>
+
+#include "ItemModels.h"
+
+// /proc/<pid>/maps 或 smaps 解析后的快照
+// 每个映射区域是定长的记录，路径驻留保存；smaps中的Rss/Pss/Swap记入所属区域
+struct MapsSnapshot
+{
+    enum Perm : quint8
+    {
+        Read = 1,
+        Write = 2,
+        Exec = 4,
+        Shared = 8,
+    };
+
+    // KB
+    struct Usage
+    {
+        qint64 rss = 0, pss = 0, swap = 0;
+
+        void add(const Usage& o) { rss += o.rss, pss += o.pss, swap += o.swap; }
+    };
+
+    struct Region
+    {
+        quint64 start = 0, end = 0;
+        quint64 offset = 0;
+        quint64 inode = 0;
+        quint32 dev = 0;        // 主设备号<<16 | 次设备号
+        quint8 perms = 0;
+        int path = 0;           // paths中的id
+        Usage use;
+
+        quint64 size() const { return end - start; }
+    };
+
+    // 同一映像(文件或匿名映射名)的所有区域
+    struct Image
+    {
+        QString name;
+        int regions = 0;
+        quint64 size = 0;       // 字节
+        quint8 perms = 0;       // 各区域权限的并集
+        Usage use;
+    };
+
+    QVector<Region> regions;
+    StringPool paths;
+    bool hasUsage = false;      // 来自smaps，区域有Rss/Pss/Swap
+    bool hasTotal = false;      // 有smaps_rollup的合计
+    Usage total;
+    int parseMs = 0;
+
+    const QString& path(const Region& r) const { return paths.str(r.path); }
+
+    static QString permText(quint8 p)
+    {
+        char s[5] = { p & Read ? 'r' : '-', p & Write ? 'w' : '-', p & Exec ? 'x' : '-', p & Shared ? 's' : 'p', 0 };
+        return s;
+    }
+
+    // maps或smaps的输出，rollup为smaps_rollup的输出(可以为空)
+    static MapsSnapshot parse(const ShellResult& maps, const ShellResult& rollup = ShellResult())
+    {
+        QElapsedTimer t;
+        t.start();
+
+        MapsSnapshot s;
+        s.paths.intern(ByteView());     // id 0 为无名匿名映射
+        auto lines = maps.lineViews();
+        s.regions.reserve(lines.size());
+        Region *last = nullptr;
+        for (auto& line : lines)
+        {
+            if (line.isEmpty()) continue;
+            // 区域行以小写十六进制地址开头，smaps的属性行以大写字母开头
+            if (isHeader(line[0]))
+            {
+                Region r;
+                if (!parseHeader(line, r, s.paths)) continue;
+                s.regions.push_back(r);
+                last = s.regions.data() + s.regions.size() - 1;
+            }
+            else if (last && attribute(line, last->use))
+                s.hasUsage = true;
+        }
+
+        for (auto line : rollup.lineViews())
+            if (!line.isEmpty() && !isHeader(line[0]) && attribute(line, s.total)) s.hasTotal = true;
+        if (!s.hasTotal && s.hasUsage)
+        {
+            for (auto& r : s.regions) s.total.add(r.use);
+            s.hasTotal = true;
+        }
+
+        s.parseMs = int(t.elapsed());
+        return s;
+    }
+
+    // 按映像合计，一次遍历，路径id直接作下标
+    QVector<Image> images() const
+    {
+        QVector<int> slot(paths.size(), -1);
+        QVector<Image> out;
+        for (auto& r : regions)
+        {
+            int& i = slot[r.path];
+            if (i < 0)
+            {
+                i = out.size();
+                out.push_back(Image());
+                out[i].name = r.path ? paths.str(r.path) : QString("[anon]");
+            }
+            auto& m = out[i];
+            ++m.regions;
+            m.size += r.size();
+            m.perms |= r.perms;
+            m.use.add(r.use);
+        }
+        return out;
+    }
+
+    // 两次快照按映像名对应，now中没有的映像以空的Image出现
+    static QVector<QPair<Image, Image>> diff(const QVector<Image>& base, const QVector<Image>& now)
+    {
+        QHash<QString, int> index;
+        for (int i = 0; i < base.size(); ++i) index.insert(base[i].name, i);
+
+        QVector<QPair<Image, Image>> out;
+        QVector<bool> matched(base.size());
+        for (auto& m : now)
+        {
+            int i = index.value(m.name, -1);
+            if (i >= 0) matched[i] = true;
+            out.push_back(qMakePair(i >= 0 ? base[i] : Image(), m));
+        }
+        for (int i = 0; i < base.size(); ++i)
+        {
+            if (matched[i]) continue;
+            Image gone;
+            gone.name = base[i].name;
+            out.push_back(qMakePair(base[i], gone));
+        }
+        return out;
+    }
+
+private:
+    static bool isHeader(char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); }
+
+    // 起始-结束 权限 偏移 主:次 节点 [路径]
+    static bool parseHeader(const ByteView& line, Region& r, StringPool& paths)
+    {
+        LineView p(line);
+        auto range = p.next();
+        int dash = range.indexOf('-');
+        bool ok1, ok2;
+        r.start = range.mid(0, dash).toULongLong(&ok1, 16);
+        r.end = range.mid(dash + 1).toULongLong(&ok2, 16);
+        if (dash < 0 || !ok1 || !ok2) return false;
+
+        auto perm = p.next();
+        if (perm.size() < 4) return false;
+        r.perms = quint8((perm[0] == 'r' ? Read : 0) | (perm[1] == 'w' ? Write : 0)
+                       | (perm[2] == 'x' ? Exec : 0) | (perm[3] == 's' ? Shared : 0));
+        r.offset = p.next().toULongLong(nullptr, 16);
+
+        auto dev = p.next();
+        int colon = dev.indexOf(':');
+        r.dev = quint32(dev.mid(0, colon).toULongLong(nullptr, 16) << 16 | dev.mid(colon + 1).toULongLong(nullptr, 16));
+        r.inode = p.next().toULongLong();
+
+        auto path = p.rest();
+        r.path = path.isEmpty() ? 0 : paths.intern(path);
+        return true;
+    }
+
+    // "Rss:   123 kB"
+    static bool attribute(const ByteView& line, Usage& u)
+    {
+        LineView p(line);
+        auto key = p.next();
+        if (key == "Rss:") u.rss = p.next().toLongLong();
+        else if (key == "Pss:") u.pss = p.next().toLongLong();
+        else if (key == "Swap:") u.swap = p.next().toLongLong();
+        else return false;
+        return true;
+    }
+};
+
+// 内存映射表格，显示区域或按映像合计；设置了基准快照时映像视图附带变化量
+// 数据直接取自快照中的定长记录，排序按数值比较
+class MapsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Mode { Regions, Images };
+
+    MapsModel(QObject *parent): QAbstractTableModel(parent) {}
+
+    void setSnapshot(const MapsSnapshot& s)
+    {
+        beginResetModel();
+        snap = s;
+        rebuild();
+        endResetModel();
+    }
+
+    void setMode(Mode m)
+    {
+        beginResetModel();
+        mode = m;
+        sortCol = -1;
+        rebuild();
+        endResetModel();
+    }
+
+    // 以当前快照作为比较的基准，clear为true时取消比较
+    void setBaseline(bool clear = false)
+    {
+        beginResetModel();
+        hasBase = !clear;
+        base = clear ? QVector<MapsSnapshot::Image>() : snap.images();
+        rebuild();
+        endResetModel();
+    }
+
+    bool hasBaseline() const { return hasBase; }
+    const MapsSnapshot& snapshot() const { return snap; }
+
+    // 区域视图中某一行的区域
+    const MapsSnapshot::Region *region(int row) const
+    {
+        return mode == Regions && row >= 0 && row < perm.size() ? &snap.regions[perm[row]] : nullptr;
+    }
+
+    // 若干行对应的区域，映像视图中为这些映像的所有区域
+    QVector<MapsSnapshot::Region> regionsAt(const QVector<int>& rows) const
+    {
+        QVector<MapsSnapshot::Region> out;
+        if (mode == Regions)
+        {
+            for (int row : rows) out.push_back(snap.regions[perm[row]]);
+            return out;
+        }
+        QSet<QString> names;
+        for (int row : rows) names.insert(images[perm[row]].second.name);
+        for (auto& r : snap.regions)
+            if (names.contains(r.path ? snap.path(r) : QString("[anon]"))) out.push_back(r);
+        return out;
+    }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : perm.size();
+    }
+
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : headers().size();
+    }
+
+    QVariant headerData(int section, Qt::Orientation o, int role) const override
+    {
+        if (o == Qt::Horizontal && role == Qt::DisplayRole) return headers().value(section);
+        return QVariant();
+    }
+
+    QVariant data(const QModelIndex& idx, int role) const override
+    {
+        int col = idx.column(), row = perm[idx.row()];
+        if (role == Qt::TextAlignmentRole && !isText(col)) return int(Qt::AlignRight | Qt::AlignVCenter);
+        if (role == Qt::ForegroundRole && mode == Images && hasBase && col >= 7)
+        {
+            auto v = number(row, col);
+            if (v > 0) return QColor(200, 0, 0);
+            if (v < 0) return QColor(0, 140, 0);
+        }
+        if (role != Qt::DisplayRole) return QVariant();
+
+        if (mode == Regions)
+        {
+            auto& r = snap.regions[row];
+            switch (col)
+            {
+            case 0: return hex(r.start);
+            case 1: return hex(r.end);
+            case 3: return MapsSnapshot::permText(r.perms);
+            case 4: return QString::number(r.offset, 16);
+            case 5: return QString("%1:%2").arg(r.dev >> 16, 2, 16, QChar('0')).arg(r.dev & 0xffff, 2, 16, QChar('0'));
+            case 6: return QString::number(r.inode);
+            case 10: return snap.path(r);
+            }
+        }
+        else if (col == 0)
+            return images[row].second.name;
+        else if (col == 6)
+            return MapsSnapshot::permText(images[row].second.perms | images[row].first.perms);
+
+        // 大小类的列
+        if (!snap.hasUsage && usageCol(col)) return QString("-");
+        auto v = number(row, col);
+        if (mode == Images && col == 1) return v;
+        if (mode == Images && col >= 7) return v == 0 ? QString() : (v > 0 ? "+" : "-") + storageSize(qAbs(v));
+        return storageSize(v);
+    }
+
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override
+    {
+        sortCol = column;
+        sortOrder = order;
+        emit layoutAboutToBeChanged();
+        auto from = persistentIndexList();
+        QVector<int> rows;
+        for (auto& i : from) rows.push_back(perm[i.row()]);
+
+        sortRows();
+
+        QVector<int> pos(perm.size());
+        for (int i = 0; i < perm.size(); ++i) pos[perm[i]] = i;
+        QModelIndexList to;
+        for (int i = 0; i < from.size(); ++i)
+            to.push_back(index(pos[rows[i]], from[i].column()));
+        changePersistentIndexList(from, to);
+        emit layoutChanged();
+    }
+
+private:
+    QStringList headers() const
+    {
+        if (mode == Regions)
+            return { "起始", "结束", "大小", "权限", "偏移", "设备号", "节点号", "RSS", "PSS", "Swap", "文件名" };
+        QStringList h{ "映像", "区域数", "大小", "RSS", "PSS", "Swap", "权限" };
+        if (hasBase) h << "Δ大小" << "ΔRSS" << "ΔPSS" << "ΔSwap";
+        return h;
+    }
+
+    bool isText(int col) const
+    {
+        return mode == Regions ? col == 3 || col == 10 : col == 0 || col == 6;
+    }
+
+    bool usageCol(int col) const
+    {
+        return mode == Regions ? col >= 7 && col <= 9 : (col >= 3 && col <= 5) || col >= 8;
+    }
+
+    static QString hex(quint64 v) { return QString("%1").arg(v, 12, 16, QChar('0')); }
+
+    // 数值列，大小的单位为KB
+    qint64 number(int row, int col) const
+    {
+        if (mode == Regions)
+        {
+            auto& r = snap.regions[row];
+            switch (col)
+            {
+            case 0: return qint64(r.start);
+            case 1: return qint64(r.end);
+            case 2: return qint64(r.size() / 1024);
+            case 4: return qint64(r.offset);
+            case 5: return r.dev;
+            case 6: return qint64(r.inode);
+            case 7: return r.use.rss;
+            case 8: return r.use.pss;
+            case 9: return r.use.swap;
+            }
+            return 0;
+        }
+
+        auto& b = images[row].first;
+        auto& m = images[row].second;
+        switch (col)
+        {
+        case 1: return m.regions;
+        case 2: return qint64(m.size / 1024);
+        case 3: return m.use.rss;
+        case 4: return m.use.pss;
+        case 5: return m.use.swap;
+        case 7: return qint64(m.size / 1024) - qint64(b.size / 1024);
+        case 8: return m.use.rss - b.use.rss;
+        case 9: return m.use.pss - b.use.pss;
+        case 10: return m.use.swap - b.use.swap;
+        }
+        return 0;
+    }
+
+    void rebuild()
+    {
+        images.clear();
+        if (mode == Images)
+        {
+            if (hasBase) images = MapsSnapshot::diff(base, snap.images());
+            else for (auto& m : snap.images()) images.push_back(qMakePair(MapsSnapshot::Image(), m));
+        }
+        perm.resize(mode == Regions ? snap.regions.size() : images.size());
+        for (int i = 0; i < perm.size(); ++i) perm[i] = i;
+        sortRows();
+    }
+
+    void sortRows()
+    {
+        if (sortCol < 0) return;
+        auto less = [this](int a, int b) {
+            if (!isText(sortCol)) return number(a, sortCol) < number(b, sortCol);
+            if (mode == Regions && sortCol == 10) return snap.regions[a].path != snap.regions[b].path &&
+                snap.paths.str(snap.regions[a].path) < snap.paths.str(snap.regions[b].path);
+            if (mode == Regions) return snap.regions[a].perms < snap.regions[b].perms;
+            if (sortCol == 6) return images[a].second.perms < images[b].second.perms;
+            return images[a].second.name < images[b].second.name;
+        };
+        if (sortOrder == Qt::AscendingOrder)
+            std::stable_sort(perm.begin(), perm.end(), less);
+        else
+            std::stable_sort(perm.begin(), perm.end(), [&less](int a, int b) { return less(b, a); });
+    }
+
+    MapsSnapshot snap;
+    Mode mode = Regions;
+    bool hasBase = false;
+    QVector<MapsSnapshot::Image> base;
+    QVector<QPair<MapsSnapshot::Image, MapsSnapshot::Image>> images;    // 基准, 当前
+    QVector<int> perm;          // 显示顺序 -> 存储顺序
+    int sortCol = -1;
+    Qt::SortOrder sortOrder = Qt::AscendingOrder;
+};
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <QObject>
+#include <QAbstractTableModel>
+#include <QElapsedTimer>
+
+#include "FastScan.h"
+#include "MapsAnalyzer.h"
+
+// 要查找的字节序列，mask中为0的字节是通配
+struct BytePattern
+{
+    QByteArray bytes;
+    QByteArray mask;
+    int anchor = 0;         // 向量化初筛比较的两个固定字节的位置
+    int anchor2 = -1;
+
+    bool isEmpty() const { return anchor < 0 || bytes.isEmpty(); }
+    int size() const { return bytes.size(); }
+
+    // "48 8B ?? 05" 或 "488b??05"，??为通配
+    static BytePattern fromHex(const QString& text)
+    {
+        BytePattern p;
+        auto s = text.toLatin1();
+        s.replace(' ', "");
+        if (s.size() % 2) return BytePattern();
+        for (int i = 0; i < s.size(); i += 2)
+        {
+            if (s[i] == '?' && s[i + 1] == '?')
+            {
+                p.bytes.append('\0');
+                p.mask.append('\0');
+                continue;
+            }
+            bool ok;
+            int v = s.mid(i, 2).toInt(&ok, 16);
+            if (!ok) return BytePattern();
+            p.bytes.append(char(v));
+            p.mask.append(char(0xff));
+        }
+        p.chooseAnchors();
+        return p;
+    }
+
+    static BytePattern fromText(const QString& text, bool utf16)
+    {
+        BytePattern p;
+        if (utf16)
+        {
+            for (auto c : text)
+            {
+                p.bytes.append(char(c.unicode() & 0xff));
+                p.bytes.append(char(c.unicode() >> 8));
+            }
+        }
+        else p.bytes = text.toUtf8();
+        p.mask = QByteArray(p.bytes.size(), char(0xff));
+        p.chooseAnchors();
+        return p;
+    }
+
+    bool matchAt(const char *p) const
+    {
+        for (int j = 0; j < bytes.size(); ++j)
+            if ((p[j] ^ bytes[j]) & mask[j]) return false;
+        return true;
+    }
+
+    // 对p[0, n)中每个完整匹配的起始位置调用f(pos)
+    // 先用SSE2一次比较16个位置的两个锚定字节，只对候选位置逐字节核对
+    template<class F>
+    void forEachMatch(const char *p, int n, F f) const
+    {
+        int last = n - bytes.size();
+        int i = 0;
+        if (isEmpty() || last < 0) return;
+#ifdef FASTSCAN_SSE2
+        const __m128i a = _mm_set1_epi8(bytes[anchor]);
+        const __m128i b = _mm_set1_epi8(anchor2 >= 0 ? bytes[anchor2] : bytes[anchor]);
+        int off2 = anchor2 >= 0 ? anchor2 : anchor;
+        for (; i + 15 <= last; i += 16)
+        {
+            __m128i x = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i + anchor)), a);
+            __m128i y = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(p + i + off2)), b);
+            unsigned m = unsigned(_mm_movemask_epi8(_mm_and_si128(x, y)));
+            while (m)
+            {
+                int k = i + FastScan::ctz(m);
+                m &= m - 1;
+                if (matchAt(p + k)) f(k);
+            }
+        }
+#endif
+        for (; i <= last; ++i)
+            if (matchAt(p + i)) f(i);
+    }
+
+private:
+    // 内存里0、0xff和可打印字符最多，锚定字节尽量选其他值，候选位置才少
+    static int commonness(quint8 c)
+    {
+        if (c == 0) return 3;
+        if (c == 0xff) return 2;
+        return c >= 0x20 && c < 0x7f ? 1 : 0;
+    }
+
+    void chooseAnchors()
+    {
+        anchor = anchor2 = -1;
+        for (int i = 0; i < bytes.size(); ++i)
+        {
+            if (!mask[i]) continue;
+            int c = commonness(quint8(bytes[i]));
+            if (anchor < 0 || c < commonness(quint8(bytes[anchor]))) anchor2 = anchor, anchor = i;
+            else if (anchor2 < 0 || c < commonness(quint8(bytes[anchor2]))) anchor2 = i;
+        }
+    }
+};
+
+// 通过exec流读取 /proc/<pid>/mem
+// 设备上常驻一个shell循环，每行请求"起始页 页数"，dd按页输出；conv=sync保证输出长度固定，
+// 读不了的页补0，不会打乱后面的数据。需要root(或adb root)
+class MemReader
+{
+public:
+    enum { Page = 4096 };
+
+    MemReader(const QString& serial, int pid): serial(serial), pid(pid) {}
+
+    bool open()
+    {
+        // 先确认有权限读mem，否则dd没有输出，读取会一直等到超时
+        auto script = QString("cd /proc/%1 && [ -r mem ] || exit 1; echo ok; "
+                              "while read s c; do dd if=mem bs=%2 skip=$s count=$c conv=noerror,sync 2>/dev/null; done")
+                              .arg(pid).arg(int(Page));
+        for (auto cmd : { "su -c " + AdbDevice::quote(script), script })
+        {
+            char ok[3];
+            if (AdbClient::open(sock, serial, "exec:" + cmd.toUtf8()))
+            {
+                sock.setTimeout(10 * 1000);
+                sock.setBufferSize(1024 * 1024);
+                if (sock.readFully(ok, 3) && memcmp(ok, "ok\n", 3) == 0) return true;
+            }
+            sock.close();
+        }
+        return false;
+    }
+
+    bool isOpen() const { return sock.isOpen(); }
+
+    // 读取从页边界addr开始的pages页到out
+    bool readPages(quint64 addr, int pages, char *out)
+    {
+        auto req = QByteArray::number(addr / Page) + ' ' + QByteArray::number(pages) + '\n';
+        if (sock.write(req) && sock.readFully(out, pages * Page)) return true;
+        sock.close();
+        return false;
+    }
+
+    // 读取任意范围
+    QByteArray read(quint64 addr, int len)
+    {
+        quint64 first = addr / Page * Page;
+        int pages = int((addr + len - first + Page - 1) / Page);
+        QByteArray buf(pages * Page, Qt::Uninitialized);
+        if (!readPages(first, pages, buf.data())) return QByteArray();
+        return buf.mid(int(addr - first), len);
+    }
+
+private:
+    QString serial;
+    int pid;
+    AdbSocket sock;
+};
+
+// 在进程内存中查找字节序列
+// 各区域按ChunkPages页分块读取，每块与上一块末尾的size-1字节拼接后扫描，
+// 所以跨块的匹配不会漏掉；本机内存只占一块数据和有上限的结果
+class MemScanner : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum
+    {
+        ChunkPages = 256,       // 1 MB
+        MaxMatches = 10000,
+        Preview = 48,           // 结果中保存的字节数
+    };
+
+    struct Match
+    {
+        quint64 addr;
+        QString path;
+        QByteArray preview;     // 从addr开始
+    };
+
+    MemScanner(QObject *parent): QObject(parent) {}
+    ~MemScanner() { stop(); }
+
+    bool isRunning() const { return worker.isRunning(); }
+
+    void start(AdbDevice *dev, int pid, const BytePattern& pattern, const QVector<MapsSnapshot::Region>& regions,
+               const MapsSnapshot& snap)
+    {
+        stop();
+        ++gen;
+        if (pattern.isEmpty()) return;
+        token = CancelToken();
+
+        // 没有读权限的区域、vvar和设备映射(读取可能有副作用)跳过
+        QVector<QPair<MapsSnapshot::Region, QString>> list;
+        for (auto& r : regions)
+        {
+            auto& path = snap.path(r);
+            if (!(r.perms & MapsSnapshot::Read) || path == "[vvar]") continue;
+            if (path.startsWith("/dev/") && !path.startsWith("/dev/ashmem")) continue;
+            list.push_back(qMakePair(r, path));
+        }
+        worker = Async::run([this, serial = dev->name, pid, pattern, list, token = token] { scan(serial, pid, pattern, list, token); });
+    }
+
+    void stop()
+    {
+        token.cancel();
+        worker.waitForFinished();
+    }
+
+Q_SIGNALS:
+    void progress(qint64 done, qint64 total);
+    void found(const QVector<MemScanner::Match>& matches);
+    void finished(const QString& error);
+
+private:
+    // 后台线程
+    void scan(const QString& serial, int pid, const BytePattern& pattern,
+              const QVector<QPair<MapsSnapshot::Region, QString>>& regions, CancelToken token)
+    {
+        qint64 total = 0, done = 0;
+        for (auto& r : regions) total += r.first.size();
+
+        MemReader reader(serial, pid);
+        if (!reader.open())
+        {
+            post([this] { emit finished("无法读取进程内存(需要root)"); });
+            return;
+        }
+
+        int keep = pattern.size() - 1;
+        int count = 0;
+        QElapsedTimer shown;
+        shown.start();
+        QByteArray buf(keep + ChunkPages * MemReader::Page, Qt::Uninitialized);
+        QVector<Match> batch;
+        for (auto& item : regions)
+        {
+            auto& r = item.first;
+            int carry = 0;      // buf开头是上一块末尾的数据
+            for (quint64 addr = r.start; addr < r.end && !token.cancelled(); )
+            {
+                int pages = int(qMin<quint64>(ChunkPages, (r.end - addr) / MemReader::Page));
+                if (pages <= 0) break;
+                if (!reader.readPages(addr, pages, buf.data() + carry))
+                {
+                    post([this] { emit finished("读取中断"); });
+                    return;
+                }
+
+                int n = carry + pages * MemReader::Page;
+                quint64 base = addr - carry;
+                pattern.forEachMatch(buf.constData(), n, [&](int pos) {
+                    if (count >= MaxMatches) return;
+                    ++count;
+                    batch.push_back(Match{ base + pos, item.second, buf.mid(pos, qMin<int>(Preview, n - pos)) });
+                });
+
+                carry = qMin(keep, n);
+                memmove(buf.data(), buf.constData() + n - carry, carry);
+                addr += quint64(pages) * MemReader::Page;
+                done += pages * MemReader::Page;
+
+                if (batch.size())
+                {
+                    post([this, batch] { emit found(batch); });
+                    batch.clear();
+                }
+                if (shown.elapsed() >= 100)
+                {
+                    shown.restart();
+                    post([this, done, total] { emit progress(done, total); });
+                }
+                if (count >= MaxMatches) break;
+            }
+            if (token.cancelled() || count >= MaxMatches) break;
+        }
+        post([this, done, total] { emit progress(done, total); });
+        QString msg;
+        if (count >= MaxMatches) msg = QString("结果超过%1个，已停止").arg(int(MaxMatches));
+        else if (token.cancelled()) msg = "已停止";
+        post([this, msg] { emit finished(msg); });
+    }
+
+    // 交给界面线程；停止后重新开始时，上一次还在队列中的结果丢弃
+    template<class F>
+    void post(F f)
+    {
+        int g = gen;
+        QMetaObject::invokeMethod(this, [this, g, f] { if (g == gen) f(); }, Qt::QueuedConnection);
+    }
+
+    QFuture<void> worker;
+    CancelToken token;
+    int gen = 0;
+};
+
+// 查找结果
+class MatchModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    MatchModel(QObject *parent): QAbstractTableModel(parent) {}
+
+    void clear()
+    {
+        beginResetModel();
+        matches.clear();
+        endResetModel();
+    }
+
+    void append(const QVector<MemScanner::Match>& list)
+    {
+        if (list.isEmpty()) return;
+        beginInsertRows(QModelIndex(), matches.size(), matches.size() + list.size() - 1);
+        matches += list;
+        endInsertRows();
+    }
+
+    const MemScanner::Match& match(int row) const { return matches[row]; }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : matches.size();
+    }
+
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : 3;
+    }
+
+    QVariant headerData(int section, Qt::Orientation o, int role) const override
+    {
+        static const char *names[] = { "地址", "区域", "内容" };
+        if (o == Qt::Horizontal && role == Qt::DisplayRole) return QString(names[section]);
+        return QVariant();
+    }
+
+    QVariant data(const QModelIndex& idx, int role) const override
+    {
+        if (role != Qt::DisplayRole) return QVariant();
+        auto& m = matches[idx.row()];
+        switch (idx.column())
+        {
+        case 0: return QString("%1").arg(m.addr, 12, 16, QChar('0'));
+        case 1: return m.path;
+        case 2: return printable(m.preview);
+        }
+        return QVariant();
+    }
+
+    static QString printable(const QByteArray& data)
+    {
+        QString s;
+        for (char c : data) s += c >= 0x20 && c < 0x7f ? QChar(c) : QChar('.');
+        return s;
+    }
+
+    // 每行16字节: 地址 十六进制 ASCII
+    static QString hexDump(quint64 addr, const QByteArray& data)
+    {
+        QString out;
+        for (int i = 0; i < data.size(); i += 16)
+        {
+            auto row = data.mid(i, 16);
+            out += QString("%1  ").arg(addr + i, 12, 16, QChar('0'));
+            for (int j = 0; j < 16; ++j)
+                out += j < row.size() ? QString("%1 ").arg(quint8(row[j]), 2, 16, QChar('0')) : QString("   ");
+            out += " " + printable(row) + "\n";
+        }
+        return out;
+    }
+
+private:
+    QVector<MemScanner::Match> matches;
+};
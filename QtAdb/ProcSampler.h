@@ -0,0 +1,470 @@
+#pragma once
+
+#include <QObject>
+#include <QWidget>
+#include <QPainter>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QtMath>
+#include <QAbstractTableModel>
+#include <algorithm>
+
+#include "AdbDevice.h"
+
+// 定长的历史数据，写满后覆盖最早的
+class History
+{
+public:
+    History(int capacity = 300): buf(capacity) {}
+
+    void push(double v)
+    {
+        buf[head] = v;
+        head = (head + 1) % buf.size();
+        if (count < buf.size()) ++count;
+    }
+
+    void clear() { head = count = 0; }
+
+    int capacity() const { return buf.size(); }
+    int size() const { return count; }
+
+    // 0为最早的一个
+    double at(int i) const { return buf[(head - count + i + buf.size()) % buf.size()]; }
+    double last() const { return count ? at(count - 1) : 0; }
+
+    double max() const
+    {
+        double m = 0;
+        for (int i = 0; i < count; ++i) m = qMax(m, at(i));
+        return m;
+    }
+
+private:
+    QVector<double> buf;
+    int head = 0;
+    int count = 0;
+};
+
+// 一次采样的原始计数，时间单位为时钟节拍(USER_HZ，Android上固定为100)
+struct ProcSample
+{
+    struct Thread
+    {
+        int tid = 0;
+        QString name;
+        char state = '?';
+        qint64 ticks = 0;       // utime + stime
+        int cpu = -1;           // 最近运行的核心
+    };
+
+    double uptime = 0;          // 设备开机时间(秒)
+    qint64 ticks = -1;          // 进程累计CPU时间，-1表示进程已不存在
+    qint64 selfTicks = 0;       // 采样shell及其子进程的CPU时间
+    qint64 vsize = 0;           // 字节
+    qint64 rss = 0;             // 页
+    qint64 readBytes = -1, writeBytes = -1;    // io，无权限时为-1
+    qint64 pss = -1;            // KB，本次没有读取时为-1
+    QVector<Thread> threads;
+
+    // 采样脚本一次的输出:
+    //  @u 开机时间
+    //  采样shell的stat、进程的stat、statm、io、各线程的stat [smaps_rollup]
+    static ProcSample parse(const ShellResult& out)
+    {
+        ProcSample s;
+        int stats = 0;
+        for (auto line : out.lineViews())
+        {
+            if (line.isEmpty()) continue;
+            LineView p(line);
+            if (line.startsWith('@'))
+            {
+                if (p.next() == "@u") s.uptime = p.next().toString().toDouble();
+                continue;
+            }
+
+            int open = line.indexOf('('), close = line.lastIndexOf(')');
+            if (open > 0 && close > open)
+            {
+                // pid (comm) state ppid ...，comm中可能有空格和括号
+                ByteView f[40];
+                int n = LineView(line.mid(close + 1)).split(f, 40);
+                if (n < 22) continue;
+                qint64 t = f[11].toLongLong() + f[12].toLongLong();
+                switch (stats++)
+                {
+                case 0:
+                    s.selfTicks = t + f[13].toLongLong() + f[14].toLongLong();    // 含已结束的子进程(cat)
+                    break;
+                case 1:
+                    s.ticks = t;
+                    s.vsize = f[20].toLongLong();
+                    break;
+                default:
+                {
+                    Thread th;
+                    th.tid = p.next().toInt();
+                    th.name = line.mid(open + 1, close - open - 1).toString();
+                    th.state = f[0].isEmpty() ? '?' : f[0][0];
+                    th.ticks = t;
+                    if (n > 36) th.cpu = f[36].toInt();
+                    s.threads.push_back(th);
+                }
+                }
+                continue;
+            }
+
+            auto key = p.next();
+            if (key.size() > 1 && key[key.size() - 1] == ':')
+            {
+                auto v = p.next().toLongLong();
+                if (key == "read_bytes:") s.readBytes = v;
+                else if (key == "write_bytes:") s.writeBytes = v;
+                else if (key == "Pss:") s.pss = v;
+                continue;
+            }
+
+            // statm: size resident shared text lib data dt
+            if (stats == 2 && s.rss == 0)
+            {
+                p.next();
+                s.rss = p.next().toLongLong();
+            }
+        }
+        if (stats < 2) s.ticks = -1;
+        return s;
+    }
+};
+
+// 进程资源采样
+// 设备上常驻一个shell循环，每次采样本机写一行，循环用一条cat读出所有/proc文件，
+// 省去每次启动su和shell的开销；smaps_rollup需要遍历页表，每隔几次才读一次
+// 计数在后台线程读取解析，差值和历史在界面线程计算
+class ProcSampler : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum
+    {
+        ClockTicks = 100,
+        PssEvery = 5,           // 每几次采样读一次PSS
+    };
+
+    struct ThreadStat
+    {
+        ProcSample::Thread t;
+        double cpu = 0;         // %
+    };
+
+    ProcSampler(QObject *parent, int intervalMs = 1000): QObject(parent), interval(intervalMs) {}
+
+    ~ProcSampler() { stop(); }
+
+    // 开始采样，已在采样同一进程时不重复启动
+    void start(AdbDevice *dev, int pid)
+    {
+        if (dev == this->dev && pid == this->pid && worker.isRunning()) return;
+        stop();
+        if (dev != this->dev || pid != this->pid) reset();
+        this->dev = dev;
+        this->pid = pid;
+        if (!dev || pid <= 0) return;
+        token = CancelToken();
+        worker = Async::run([this, dev, pid, interval = interval, token = token] { run(dev, pid, interval, token); });
+    }
+
+    void stop()
+    {
+        token.cancel();
+        worker.waitForFinished();
+    }
+
+    void reset()
+    {
+        for (auto h : { &cpu, &rss, &pss, &ioRead, &ioWrite }) h->clear();
+        prev = ProcSample();
+        threads.clear();
+        rssDelta = pssDelta = 0;
+        lastPss = -1;
+        overhead = 0;
+        gone = false;
+        emit sampled();
+    }
+
+    // 最近一次采样的原始计数
+    const ProcSample& last() const { return prev; }
+
+    // 历史: CPU(%)、RSS/PSS(KB)、读写(字节/秒)
+    History cpu, rss, pss, ioRead, ioWrite;
+    QVector<ThreadStat> threads;    // 最近一次采样，按tid排序
+    qint64 rssDelta = 0, pssDelta = 0;  // KB，与上一次采样相比
+    double overhead = 0;            // 采样本身占用设备CPU的比例(%)
+    bool gone = false;              // 进程已结束
+
+Q_SIGNALS:
+    void sampled();
+
+private:
+    // 后台线程
+    void run(AdbDevice *dev, int pid, int interval, CancelToken token)
+    {
+        bool ok = false;
+        pageKB = qMax(1, dev->shell({ "getconf", "PAGESIZE" }).trimmed().toInt() / 1024);
+        if (pageKB <= 1) pageKB = 4;
+
+        // cat依次输出: 采样shell自身、进程stat、statm、io、线程stat；读PSS时再接smaps_rollup
+        auto script = QString("cd /proc/%1 || exit 1; while read l; do read u x < /proc/uptime; echo \"@u $u\"; "
+                              "if [ \"$l\" = p ]; then cat /proc/$$/stat stat statm io task/*/stat smaps_rollup; "
+                              "else cat /proc/$$/stat stat statm io task/*/stat; fi 2>/dev/null; echo @end; done").arg(pid);
+        // 先用root读取io和smaps_rollup，没有su时退回普通权限，stat和statm仍可读
+        for (auto cmd : { "su -c " + AdbDevice::quote(script), script })
+        {
+            if (token.cancelled() || ok) break;
+            AdbSocket s;
+            if (!AdbClient::open(s, dev->name, "exec:" + cmd.toUtf8())) continue;
+            s.setTimeout(5000);
+
+            QByteArray buf;
+            for (int n = 0; !token.cancelled(); ++n)
+            {
+                QElapsedTimer t;
+                t.start();
+                if (!s.write(n % PssEvery == 0 ? "p\n" : "\n")) break;
+
+                // 每次输出以@u行开始，结束标记前总有换行
+                int end;
+                char chunk[16 * 1024];
+                while ((end = buf.indexOf("\n@end\n")) < 0)
+                {
+                    int r = s.read(chunk, sizeof(chunk));
+                    if (r <= 0) break;
+                    buf.append(chunk, r);
+                }
+                if (end < 0) break;
+
+                auto sample = ProcSample::parse(ShellResult(buf.left(end + 1)));
+                buf.remove(0, end + 6);
+                // su启动失败或被拒绝时输出为空，换普通权限
+                if (!ok && sample.uptime <= 0) break;
+                ok = true;
+                QMetaObject::invokeMethod(this, [this, sample] { accept(sample); }, Qt::QueuedConnection);
+                if (sample.ticks < 0) return;
+
+                int wait = interval - int(t.elapsed());
+                for (; wait > 0 && !token.cancelled(); wait -= 50)
+                    QThread::msleep(ulong(qMin(wait, 50)));
+            }
+        }
+        // 进程不存在时cd失败，没有任何输出
+        if (!ok && !token.cancelled())
+            QMetaObject::invokeMethod(this, [this] { accept(ProcSample()); }, Qt::QueuedConnection);
+    }
+
+    // 界面线程: 与上一次采样求差
+    void accept(const ProcSample& s)
+    {
+        gone = s.ticks < 0;
+        if (gone)
+        {
+            emit sampled();
+            return;
+        }
+
+        double dt = prev.uptime > 0 ? s.uptime - prev.uptime : 0;
+        auto rate = [dt](qint64 now, qint64 old) {
+            return dt > 0 && now >= 0 && old >= 0 ? (now - old) / dt : 0.0;
+        };
+
+        if (dt > 0)
+        {
+            cpu.push(rate(s.ticks, prev.ticks) * 100 / ClockTicks);
+            overhead = rate(s.selfTicks, prev.selfTicks) * 100 / ClockTicks;
+            ioRead.push(rate(s.readBytes, prev.readBytes));
+            ioWrite.push(rate(s.writeBytes, prev.writeBytes));
+        }
+
+        qint64 rssKB = s.rss * pageKB;
+        rssDelta = prev.uptime > 0 ? rssKB - prev.rss * pageKB : 0;
+        rss.push(rssKB);
+        if (s.pss >= 0)
+        {
+            pssDelta = lastPss >= 0 ? s.pss - lastPss : 0;
+            lastPss = s.pss;
+        }
+        if (lastPss >= 0) pss.push(lastPss);
+
+        // 线程按tid对应上一次的计数
+        QHash<int, qint64> old;
+        for (auto& t : prev.threads) old.insert(t.tid, t.ticks);
+        threads.resize(s.threads.size());
+        for (int i = 0; i < s.threads.size(); ++i)
+        {
+            auto& t = s.threads[i];
+            threads[i].t = t;
+            threads[i].cpu = rate(t.ticks, old.value(t.tid, -1)) * 100 / ClockTicks;
+        }
+        std::sort(threads.begin(), threads.end(), [](const ThreadStat& a, const ThreadStat& b) { return a.t.tid < b.t.tid; });
+
+        prev = s;
+        emit sampled();
+    }
+
+    AdbDevice *dev = nullptr;
+    int pid = 0;
+    int interval;
+    int pageKB = 4;
+    QFuture<void> worker;
+    CancelToken token;
+
+    ProcSample prev;
+    qint64 lastPss = -1;
+};
+
+// 线程列表，tid不变时原地更新，保留选中和排序
+class ThreadModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    ThreadModel(ProcSampler *sampler, QObject *parent): QAbstractTableModel(parent), sampler(sampler)
+    {
+        connect(sampler, &ProcSampler::sampled, this, &ThreadModel::refresh);
+    }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : tids.size();
+    }
+
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : 6;
+    }
+
+    QVariant headerData(int section, Qt::Orientation o, int role) const override
+    {
+        static const char *names[] = { "TID", "名称", "状态", "CPU%", "CPU时间", "核心" };
+        if (o == Qt::Horizontal && role == Qt::DisplayRole) return QString(names[section]);
+        return QVariant();
+    }
+
+    QVariant data(const QModelIndex& idx, int role) const override
+    {
+        auto& s = sampler->threads[idx.row()];
+        // 排序用数值
+        if (role == Qt::UserRole)
+        {
+            switch (idx.column())
+            {
+            case 3: return s.cpu;
+            case 4: return s.t.ticks;
+            }
+            role = Qt::DisplayRole;
+        }
+        if (role == Qt::TextAlignmentRole && idx.column() != 1) return int(Qt::AlignRight | Qt::AlignVCenter);
+        if (role != Qt::DisplayRole) return QVariant();
+        switch (idx.column())
+        {
+        case 0: return s.t.tid;
+        case 1: return s.t.name;
+        case 2: return QString(QChar(s.t.state));
+        case 3: return QString::number(s.cpu, 'f', 1);
+        case 4: return QString::number(s.t.ticks / double(ProcSampler::ClockTicks), 'f', 2);
+        case 5: return s.t.cpu;
+        }
+        return QVariant();
+    }
+
+private:
+    void refresh()
+    {
+        QVector<int> now;
+        for (auto& s : sampler->threads) now.push_back(s.t.tid);
+        if (now != tids)
+        {
+            beginResetModel();
+            tids = now;
+            endResetModel();
+        }
+        else if (tids.size())
+            emit dataChanged(index(0, 2), index(tids.size() - 1, columnCount() - 1));
+    }
+
+    ProcSampler *sampler;
+    QVector<int> tids;
+};
+
+// 折线图，横轴为采样次数，最新的在右侧，纵轴按可见数据的最大值缩放
+class SeriesChart : public QWidget
+{
+public:
+    typedef std::function<QString(double)> Formatter;
+
+    SeriesChart(const QString& title, const Formatter& fmt, QWidget *parent = nullptr)
+        : QWidget(parent), title(title), fmt(fmt)
+    {
+        setMinimumHeight(120);
+    }
+
+    void addSeries(const History *h, const QString& name, const QColor& color)
+    {
+        series.push_back(Series{ h, name, color });
+    }
+
+protected:
+    void paintEvent(QPaintEvent *) override
+    {
+        QPainter p(this);
+        p.fillRect(rect(), Qt::white);
+        QRect area = rect().adjusted(4, 20, -4, -4);
+        if (series.isEmpty() || area.width() < 2 || area.height() < 2) return;
+
+        // 纵轴上限取1、2、5的整数倍
+        double top = 0;
+        for (auto& s : series) top = qMax(top, s.h->max());
+        double step = top > 0 ? qPow(10, qFloor(std::log10(top))) : 1;
+        for (double m : { 1, 2, 5, 10 })
+            if (m * step >= top) { top = m * step; break; }
+
+        p.setPen(QColor(230, 230, 230));
+        for (int i = 0; i <= 4; ++i)
+        {
+            int y = area.bottom() - area.height() * i / 4;
+            p.drawLine(area.left(), y, area.right(), y);
+        }
+
+        p.setRenderHint(QPainter::Antialiasing);
+        QString legend = title + "  ";
+        double dx = double(area.width()) / (series[0].h->capacity() - 1);
+        for (auto& s : series)
+        {
+            int n = s.h->size();
+            QPolygonF line(n);
+            for (int i = 0; i < n; ++i)
+                line[i] = QPointF(area.right() - (n - 1 - i) * dx, area.bottom() - s.h->at(i) / top * area.height());
+            p.setPen(QPen(s.color, 1.5));
+            p.drawPolyline(line);
+            legend += QString("%1 %2  ").arg(s.name, fmt(s.h->last()));
+        }
+
+        p.setRenderHint(QPainter::Antialiasing, false);
+        p.setPen(Qt::black);
+        p.drawText(rect().adjusted(6, 2, -6, 0), Qt::AlignLeft | Qt::AlignTop, legend);
+        p.setPen(Qt::gray);
+        p.drawText(rect().adjusted(6, 2, -6, 0), Qt::AlignRight | Qt::AlignTop, fmt(top));
+    }
+
+private:
+    struct Series
+    {
+        const History *h;
+        QString name;
+        QColor color;
+    };
+
+    QString title;
+    Formatter fmt;
+    QVector<Series> series;
+};
@@ -1,15 +1,76 @@
 #include "PsDlg.h"
 #include "QtAdb.h"
 
+#include <QSortFilterProxyModel>
+
 PsDlg::PsDlg(QWidget *parent, AdbDevice *cd, int pid)
     : QDialog(parent), cd(cd), pid(pid)
 {
     ui.setupUi(this);
 
+    memModel = new MapsModel(this);
+    ui.tableMemory->setModel(memModel);
+    ui.tableMemory->sortByColumn(0, Qt::AscendingOrder);
+    connect(ui.comboMemView, static_cast<void(QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &PsDlg::setMemoryView);
+    connect(ui.buttonBaseline, &QPushButton::toggled, this, &PsDlg::setBaseline);
+    connect(ui.buttonMemRefresh, &QPushButton::clicked, this, [this] { updateMemory(); });
+    connect(ui.checkSmaps, &QCheckBox::toggled, this, [this] { updateMemory(); });
+
+    scanner = new MemScanner(this);
+    matchModel = new MatchModel(this);
+    ui.tableMatches->setModel(matchModel);
+    ui.tableMatches->setColumnWidth(0, 110);
+    ui.tableMatches->setColumnWidth(1, 220);
+    QFont mono("Consolas");
+    mono.setStyleHint(QFont::Monospace);
+    ui.textHex->setFont(mono);
+    connect(ui.buttonScan, &QPushButton::clicked, this, &PsDlg::scanMemory);
+    connect(ui.editPattern, &QLineEdit::returnPressed, this, [this] { if (!scanner->isRunning()) scanMemory(); });
+    connect(scanner, &MemScanner::found, matchModel, &MatchModel::append);
+    connect(scanner, &MemScanner::progress, this, [this](qint64 done, qint64 total) {
+        ui.labelScan->setText(QString("%1 / %2 MB, 找到 %3").arg(done >> 20).arg(total >> 20).arg(matchModel->rowCount()));
+    });
+    connect(scanner, &MemScanner::finished, this, [this](const QString& err) {
+        ui.buttonScan->setText("搜索");
+        ui.labelScan->setText((err.isEmpty() ? QString("完成") : err) + QString(", 找到 %1").arg(matchModel->rowCount()));
+    });
+    connect(ui.tableMatches, &QTableView::clicked, this, [this](const QModelIndex& i) { showHex(matchModel->match(i.row()).addr); });
+    connect(ui.buttonHex, &QPushButton::clicked, this, [this] {
+        bool ok;
+        auto addr = ui.editAddress->text().trimmed().remove("0x").toULongLong(&ok, 16);
+        if (ok) showHex(addr);
+    });
+
+    sampler = new ProcSampler(this);
+    connect(sampler, &ProcSampler::sampled, this, &PsDlg::showSample);
+
+    auto bytes = [](double v) {
+        if (v >= 1024 * 1024) return QString::number(v / (1024 * 1024), 'f', 1) + " MB";
+        return QString::number(v / 1024, 'f', 1) + " KB";
+    };
+    charts.push_back(new SeriesChart("CPU", [](double v) { return QString::number(v, 'f', 1) + "%"; }));
+    charts[0]->addSeries(&sampler->cpu, "进程", QColor(30, 120, 220));
+    charts.push_back(new SeriesChart("内存", [bytes](double v) { return bytes(v * 1024); }));
+    charts[1]->addSeries(&sampler->rss, "RSS", QColor(40, 160, 60));
+    charts[1]->addSeries(&sampler->pss, "PSS", QColor(200, 120, 0));
+    charts.push_back(new SeriesChart("IO", [bytes](double v) { return bytes(v) + "/s"; }));
+    charts[2]->addSeries(&sampler->ioRead, "读", QColor(120, 60, 200));
+    charts[2]->addSeries(&sampler->ioWrite, "写", QColor(200, 40, 40));
+    for (auto c : charts) ui.verticalLayout->addWidget(c, 1);
+
+    auto threads = new QSortFilterProxyModel(this);
+    threads->setSourceModel(new ThreadModel(sampler, this));
+    threads->setSortRole(Qt::UserRole);
+    ui.tableThread->setModel(threads);
+    ui.tableThread->sortByColumn(3, Qt::DescendingOrder);
+
     onTabChanged(ui.tabWidget->currentIndex());
     TableFilter::install(ui.tableMemory);
+    TableFilter::install(ui.tableThread);
 }
 
 PsDlg::~PsDlg()
 {
+    scanner->stop();
+    sampler->stop();
 }
@@ -4,6 +4,10 @@
 #include "ui_PsDlg.h"
 
 #include "AdbDevice.h"
+#include "ItemModels.h"
+#include "ProcSampler.h"
+#include "MapsAnalyzer.h"
+#include "MemScanner.h"
 
 class PsDlg : public QDialog
 {
@@ -13,45 +17,122 @@ public:
     PsDlg(QWidget *parent, AdbDevice *cd, int pid);
     ~PsDlg();
 
+    // 读取和解析都在后台；smaps比maps大十几倍，只在勾选时读取，否则只取smaps_rollup的合计
     void updateMemory()
     {
-        int i = 0;
-        for (auto l : cd->shell({ "cat", "/proc/" + QString::number(pid) + "/maps" }, true))
+        auto dir = "/proc/" + QString::number(pid);
+        bool smaps = ui.checkSmaps->isChecked();
+        auto dev = cd;
+        ui.labelMemory->setText("读取中...");
+        Async::then(this, Async::run([dev, dir, smaps] {
+            auto r = dev->shellBatch({ "cat " + dir + (smaps ? "/smaps" : "/maps"), "cat " + dir + "/smaps_rollup" }, true);
+            return MapsSnapshot::parse(r[0], r[1]);
+        }), [this](const MapsSnapshot& s) { updateMemory(s); });
+    }
+
+    void updateMemory(const MapsSnapshot& s)
+    {
+        memModel->setSnapshot(s);
+        auto text = QString("%1 个区域, %2 个映像").arg(s.regions.size()).arg(s.images().size());
+        if (s.hasTotal)
+            text += QString(", RSS %1, PSS %2, Swap %3").arg(storageSize(s.total.rss), storageSize(s.total.pss), storageSize(s.total.swap));
+        ui.labelMemory->setText(text + QString(", 解析 %1 ms").arg(s.parseMs));
+    }
+
+    void setMemoryView(int i)
+    {
+        auto mode = i == 1 ? MapsModel::Images : MapsModel::Regions;
+        memModel->setMode(mode);
+        // 映像按大小从大到小，区域按地址
+        if (mode == MapsModel::Images) ui.tableMemory->sortByColumn(2, Qt::DescendingOrder);
+        else ui.tableMemory->sortByColumn(0, Qt::AscendingOrder);
+    }
+
+    // 以当前快照为基准，之后刷新时映像视图显示变化量
+    void setBaseline(bool on)
+    {
+        memModel->setBaseline(!on);
+        if (on && ui.comboMemView->currentIndex() != 1) ui.comboMemView->setCurrentIndex(1);
+    }
+
+    // 资源和线程页共用同一个采样，切到其他页时停止
+    void updateSample(bool on)
+    {
+        if (on) sampler->start(cd, pid);
+        else sampler->stop();
+    }
+
+    void showSample()
+    {
+        if (sampler->gone)
         {
-            LineParser p(std::move(l));
-            auto addr = p.next().split("-");
-            auto& begin = addr[0];
-            auto& end = addr[1];
-            auto flag = p.next();
-            auto size = p.next();
-            auto f1 = p.next();
-            auto f2 = p.next();
-            auto image = p.rest();
-
-            ui.tableMemory->insertRow(i);
-            ui.tableMemory->setItem(i, 0, new QTableWidgetItem(begin));
-            ui.tableMemory->setItem(i, 1, new QTableWidgetItem(end));
-            ui.tableMemory->setItem(i, 2, new QTableWidgetItem(flag));
-            ui.tableMemory->setItem(i, 3, new QTableWidgetItem(size));
-            ui.tableMemory->setItem(i, 4, new QTableWidgetItem(f1));
-            ui.tableMemory->setItem(i, 5, new QTableWidgetItem(f2));
-            ui.tableMemory->setItem(i, 6, new QTableWidgetItem(image));
-
-            ++i;
+            ui.labelSample->setText("进程已结束");
+            return;
         }
+        auto kb = [](qint64 v) { return QString::number(v) + " KB"; };
+        auto delta = [](qint64 v) { return (v > 0 ? "+" : "") + QString::number(v); };
+        auto pss = sampler->pss.size() ? kb(qint64(sampler->pss.last())) + " (" + delta(sampler->pssDelta) + ")" : QString("-");
+        ui.labelSample->setText(QString("CPU %1%    RSS %2 (%3)    PSS %4    VSZ %5 MB    线程 %6    采样开销 %7%")
+            .arg(sampler->cpu.last(), 0, 'f', 1)
+            .arg(kb(qint64(sampler->rss.last()))).arg(delta(sampler->rssDelta))
+            .arg(pss)
+            .arg(sampler->last().vsize / (1024 * 1024))
+            .arg(sampler->threads.size())
+            .arg(sampler->overhead, 0, 'f', 2));
+        for (auto c : charts) c->update();
     }
 
-    void updateThread()
+    // 在内存页选中的区域(没有选中时为所有可读区域)中查找，再次点击停止
+    void scanMemory()
     {
-        int i = 0;
-        for (auto l : cd->shell({ "cat", "/proc/" + QString::number(pid) + "/task" }, true))
+        if (scanner->isRunning())
         {
+            scanner->stop();
+            return;
         }
+
+        auto text = ui.editPattern->text();
+        int kind = ui.comboPattern->currentIndex();
+        auto pattern = kind == 2 ? BytePattern::fromHex(text) : BytePattern::fromText(text, kind == 1);
+        if (pattern.isEmpty())
+        {
+            ui.labelScan->setText("查找内容无效");
+            return;
+        }
+        auto& snap = memModel->snapshot();
+        if (snap.regions.isEmpty())
+        {
+            ui.labelScan->setText("映射还没有读取完，稍后再试");
+            updateMemory();
+            return;
+        }
+
+        QVector<int> rows;
+        for (auto& i : ui.tableMemory->selectionModel()->selectedRows()) rows.push_back(i.row());
+        matchModel->clear();
+        ui.buttonScan->setText("停止");
+        scanner->start(cd, pid, pattern, rows.isEmpty() ? snap.regions : memModel->regionsAt(rows), snap);
+    }
+
+    // 显示addr附近1KB的内容
+    void showHex(quint64 addr)
+    {
+        auto dev = cd;
+        int pid = this->pid;
+        quint64 from = (addr & ~quint64(15)) - qMin<quint64>(addr & ~quint64(15), 256);
+        ui.editAddress->setText(QString::number(addr, 16));
+        Async::then(this, Async::run([dev, pid, from] {
+            MemReader reader(dev->name, pid);
+            return reader.open() ? reader.read(from, 1024) : QByteArray();
+        }), [this, from](const QByteArray& data) {
+            ui.textHex->setPlainText(data.isEmpty() ? QString("读取失败(需要root)") : MatchModel::hexDump(from, data));
+        });
     }
 
     void updateStatus()
     {
-        ui.textStatus->setPlainText(cd->shell({ "cat", "/proc/" + QString::number(pid) + "/status" }, true));
+        Async::then(this, cd->shellAsync({ "cat", "/proc/" + QString::number(pid) + "/status" }, true),
+            [this](const ShellResult& r) { ui.textStatus->setPlainText(r); });
     }
 
 public slots:
@@ -62,8 +143,9 @@ public slots:
             updateStatus();
         if (label == "内存")
             updateMemory();
-        if (label == "线程")
-            updateThread();
+        if (label == "搜索" && memModel->snapshot().regions.isEmpty())
+            updateMemory();
+        updateSample(label == "资源" || label == "线程");
     }
 
 private:
@@ -71,4 +153,9 @@ private:
 
     AdbDevice *cd = nullptr;
     int pid;
+    MapsModel *memModel;
+    MemScanner *scanner;
+    MatchModel *matchModel;
+    ProcSampler *sampler;
+    QVector<SeriesChart*> charts;
 };
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+
+#include "AdbDevice.h"
+
+// 进程列表快照，字段直接引用ps输出的原始数据
+// 与上一次快照比较得到增删改，界面只更新变化的部分
+struct PsSnapshot
+{
+    struct Entry
+    {
+        int pid = 0;
+        int ppid = 0;
+        ByteView line;      // 整行，用于快速判断是否变化
+        ByteView name, user, vsz, cmd;
+    };
+
+    struct Diff
+    {
+        QList<int> added;
+        QList<int> removed;
+        QList<int> changed;     // 字段有变化
+        QList<int> moved;       // 父进程有变化
+    };
+
+    ShellResult data;           // 持有原始输出，Entry中的ByteView指向这里
+    QHash<int, Entry> procs;
+    Diff diff;                  // 相对上一次快照的变化
+
+    // ps -A -o NAME,PID,PPID,USER,VSZ,CMDLINE 的输出(不含标题行)
+    static PsSnapshot parse(ShellResult&& out, const PsSnapshot& prev)
+    {
+        PsSnapshot s;
+        s.data = std::move(out);
+        for (auto line : s.data.lineViews())
+        {
+            LineView p(line);
+            Entry e;
+            e.line = line;
+            e.name = p.psname();
+            // 忽略线程
+            if (e.name.isEmpty() || e.name.startsWith('[')) continue;
+
+            e.pid = p.next().toInt();
+            e.ppid = p.next().toInt();
+            e.user = p.next();
+            e.vsz = p.next();
+            e.cmd = p.rest();
+            s.procs.insert(e.pid, e);
+        }
+        s.diff = compare(prev, s);
+        return s;
+    }
+
+    static Diff compare(const PsSnapshot& old, const PsSnapshot& now)
+    {
+        Diff d;
+        for (auto it = now.procs.cbegin(); it != now.procs.cend(); ++it)
+        {
+            auto o = old.procs.constFind(it.key());
+            if (o == old.procs.cend())
+            {
+                d.added.push_back(it.key());
+                continue;
+            }
+            if (o->line != it->line) d.changed.push_back(it.key());
+            if (o->ppid != it->ppid) d.moved.push_back(it.key());
+        }
+        for (auto it = old.procs.cbegin(); it != old.procs.cend(); ++it)
+            if (!now.procs.contains(it.key())) d.removed.push_back(it.key());
+        return d;
+    }
+};
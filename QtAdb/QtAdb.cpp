@@ -5,13 +5,18 @@ QtAdb::QtAdb(QWidget *parent)
 	: QMainWindow(parent)
 {
 	ui.setupUi(this);
+    logSink = new LogSink(ui.logEdit);
 
     // 替换ComboBox组件
     comboDevice = new DeviceComboBox(this);
     ui.layout1->replaceWidget(ui.comboDevice, comboDevice);
     delete ui.comboDevice;
 
+    auto style = QApplication::style();
+
     // 应用列表
+    appModel = new ColumnTableModel({ "包名", "路径" }, this);
+    ui.appList->setModel(appModel);
     ui.appList->setColumnWidth(0, 350);
     ui.appList->addAction(ui.actionStart);
     ui.appList->addAction(ui.actionStop);
@@ -21,19 +26,61 @@ QtAdb::QtAdb(QWidget *parent)
     ui.appList->addAction(ui.actionDumpService);
     ui.appList->addAction(ui.actionDumpPackage);
 
+    // 命令列表
+    ui.tableWidget->setContextMenuPolicy(Qt::ActionsContextMenu);
+    ui.tableWidget->addAction(ui.actionRunScript);
+
     // 文件列表
+    fsModel = new ColumnTableModel({ "文件", "权限", "用户", "组", "大小", "修改时间", "链接" }, this);
+    fsModel->setInterned(1);
+    fsModel->setInterned(2);
+    fsModel->setInterned(3);
+    fsModel->setFormatter(4, [](const ByteView& v) {
+        auto n = v.toLongLong();
+        return n < 1024 ? QString::number(n) : storageSize(n / 1024.0f);
+    }, true);
+    fsModel->setIcons({
+        style->standardIcon(QStyle::SP_FileIcon),
+        style->standardIcon(QStyle::SP_DirIcon),
+        style->standardIcon(QStyle::SP_FileLinkIcon),
+        style->standardIcon(QStyle::SP_DirLinkIcon),
+    });
+    ui.tableFs->setModel(fsModel);
+    ui.tableFs->setContextMenuPolicy(Qt::ActionsContextMenu);
+    ui.tableFs->addAction(ui.actionRefreshDir);
+    ui.tableFs->addAction(ui.actionPull);
+    ui.tableFs->addAction(ui.actionPush);
+    ui.tableFs->addAction(ui.actionSyncFolder);
     ui.tableFs->setColumnWidth(0, 280);
+    ui.treeFs->addAction(ui.actionRefreshDir);
     ui.tableFs->setColumnWidth(1, 90);
     ui.tableFs->setColumnWidth(2, 80);
     ui.tableFs->setColumnWidth(3, 80);
     ui.tableFs->setColumnWidth(4, 80);
+    ui.tableFs->setColumnWidth(5, 130);
 
-    // 文件树
+    // 进程树
+    psModel = new ProcessModel(this);
+    ui.treePs->setModel(psModel);
     ui.treePs->setColumnWidth(0, 350);
     ui.treePs->setColumnWidth(1, 80);
 
+    // 屏幕，替换占位的控件
+    screenView = new ScreenView(this);
+    ui.verticalLayout_6->replaceWidget(ui.screen, screenView);
+    delete ui.screen;
+    screenView->setFps(ui.spinFps->value());
+    connect(ui.spinFps, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged), screenView, &ScreenView::setFps);
+    connect(screenView, &ScreenView::frameShown, this, [this](int dirty, int total) {
+        ui.labelScreen->setText(QString("变化 %1/%2 块").arg(dirty).arg(total));
+    });
+
+    // logcat
+    logcatView = new LogcatView(this);
+    ui.verticalLayout_7->replaceWidget(ui.logcat, logcatView);
+    delete ui.logcat;
+
     // 图标设置
-    auto style = QApplication::style();
     setWindowIcon(style->standardIcon(QStyle::SP_TitleBarMenuButton));
     ui.actionStart->setIcon(style->standardIcon(QStyle::SP_MediaPlay));
     ui.actionStop->setIcon(style->standardIcon(QStyle::SP_MediaStop));
@@ -51,6 +98,14 @@ QtAdb::QtAdb(QWidget *parent)
 
     connect(comboDevice, &DeviceComboBox::deviceChanged, this, &QtAdb::changeDevice);
 
+    // 进程列表自动刷新，仅在进程页可见时执行
+    connect(ui.checkPsAuto, &QCheckBox::toggled, this, &QtAdb::setPsAutoRefresh);
+    connect(ui.spinPsInterval, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+        this, [this] { setPsAutoRefresh(ui.checkPsAuto->isChecked()); });
+    connect(&psTimer, &QTimer::timeout, this, [this] {
+        if (ui.tabWidget->currentWidget() == ui.tab_4) updatePsTree();
+    });
+
     // 添加表格的过滤功能
     TableFilter::install(ui.appList);
     TableFilter::install(ui.treePs);
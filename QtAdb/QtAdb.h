@@ -6,9 +6,23 @@
 #include <QSet>
 #include <QComboBox>
 #include <QSystemTrayIcon>
+#include <QTimer>
+#include <QDateTime>
+#include <QFileDialog>
 #include "ui_QtAdb.h"
 
 #include "AdbDevice.h"
+#include "FanOut.h"
+#include "InputInjector.h"
+#include "ScriptRunner.h"
+#include "ScreenView.h"
+#include "LogcatView.h"
+#include "LogSink.h"
+#include "FileTransfer.h"
+#include "FolderSync.h"
+#include "PsSnapshot.h"
+#include "ItemModels.h"
+#include "FilterIndex.h"
 #include "PsDlg.h"
 
 using namespace std;
@@ -30,35 +44,31 @@ public:
         emit deviceChanged((AdbDevice*)itemData(i).value<quintptr>());
     }
 
-    // 更新设备列表
+    // 更新设备列表，在后台查询，adb server未启动时启动它可能要几秒
     void updateDevices()
     {
-        auto oldDevs = devs;
-        auto set = QSet<QString>::fromList(AdbDevice::devices());
-        // 更新已有列表
+        int gen = ++listGen;
+        Async::then(this, AdbDevice::devicesAsync(), [this, gen](const QList<QString>& list) {
+            if (gen == listGen) applyDevices(list);     // 只用最后一次查询的结果
+        });
+    }
+
+    // 列表中的所有设备
+    QList<AdbDevice*> allDevices() const
+    {
+        QList<AdbDevice*> l;
         for (int i = 0; i < count(); ++i)
-        {
-            auto devName = itemText(i).split(QRegExp("\\s+"))[0];
-            auto dev = (AdbDevice*)itemData(i).value<quintptr>();
-            if (set.remove(devName))
-            {
-                // 手机型号
-                setItemText(i, devName + "\t" + dev->model());
-            }
-            else
-            {
-                // 列表里不存在的删掉
-                removeItem(i);
-                delete dev;
-            }
-        }
-        // 添加新的设备
-        for (auto devName : set)
-        {
-            auto dev = new AdbDevice(devName);
-            // 手机型号
-            addItem(devName + "\t" + dev->model(), (quintptr)dev);
-        }
+            l.push_back((AdbDevice*)itemData(i).value<quintptr>());
+        return l;
+    }
+
+    // 手机型号
+    void updateModel(AdbDevice *dev)
+    {
+        Async::then(this, dev->modelAsync(), [this, dev](const QString& model) {
+            int i = findData((quintptr)dev);
+            if (i >= 0) setItemText(i, dev->name + "\t" + model);
+        });
     }
 
 protected:
@@ -72,7 +82,30 @@ Q_SIGNALS:
     void deviceChanged(AdbDevice*);
 
 private:
-    QHash<QString, int> devs;
+    void applyDevices(const QList<QString>& list)
+    {
+        auto set = QSet<QString>::fromList(list);
+        // 更新已有列表
+        for (int i = count() - 1; i >= 0; --i)
+        {
+            auto dev = (AdbDevice*)itemData(i).value<quintptr>();
+            if (set.remove(dev->name))
+                updateModel(dev);
+            else
+                removeItem(i);  // 列表里不存在的删掉，设备对象保留，后台任务可能仍在使用
+        }
+        // 添加新的设备
+        for (auto devName : set)
+        {
+            auto& dev = devs[devName];
+            if (!dev) dev = new AdbDevice(devName);
+            addItem(devName, (quintptr)dev);
+            updateModel(dev);
+        }
+    }
+
+    QHash<QString, AdbDevice*> devs;
+    int listGen = 0;
 };
 
 class TableFilter: public QLineEdit
@@ -94,10 +127,20 @@ public:
 
 private:
     int timer = 0;
+    int seq = 0;                // 最近一次查询的序号，旧结果丢弃
+    int epoch = 0;              // 索引重建次数
+    bool indexed = false;
+    bool dirty = false;
+    bool purge = false;         // 有行被删除，查询前从索引中去掉
+    int dead = 0;               // 索引中已删除的行数
+    FilterEngine engine;
+    QVector<QPersistentModelIndex> entries;     // 索引中的行号 -> 模型中的行
+    QVector<bool> live;                         // 索引中的行是否有效
+    QVector<QPersistentModelIndex> changed;     // 内容变化、需要重新索引的行
 
     TableFilter(QWidget *parent): QLineEdit(parent)
     {
-        setPlaceholderText("过滤");
+        setPlaceholderText("过滤  列名:文本  /正则/");
         parent->installEventFilter(this);
         this->hide();
         connect(this, &QLineEdit::textChanged, this, &TableFilter::onChanged);
@@ -117,41 +160,228 @@ private:
         show(); setFocus();
     }
 
-    void doFilter(QTreeWidget *p)
+    QAbstractItemView *view() const { return qobject_cast<QAbstractItemView*>(parent()); }
+
+    // 第一次过滤时建立索引，之后随模型的增删改增量更新
+    // 界面线程只收集行的索引，文本由模型的快照在过滤线程上生成
+    void ensureIndex()
+    {
+        auto m = view()->model();
+        if (!indexed)
+        {
+            indexed = true;
+            connect(m, &QAbstractItemModel::modelReset, this, &TableFilter::invalidate);
+            connect(m, &QAbstractItemModel::dataChanged, this, &TableFilter::onDataChanged);
+            connect(m, &QAbstractItemModel::rowsInserted, this, &TableFilter::onRowsInserted);
+            connect(m, &QAbstractItemModel::rowsRemoved, this, &TableFilter::onRowsRemoved);
+            connect(m, &QAbstractItemModel::rowsMoved, this, &TableFilter::refilter);
+            // 排序后(包括动态排序的代理模型)行号全部变化，隐藏的行和索引都要重来
+            connect(m, &QAbstractItemModel::layoutChanged, this, &TableFilter::invalidate);
+            dirty = true;
+        }
+        // 删除的行过多时重建
+        if (dead > 1024 && dead > entries.size() / 2) dirty = true;
+        if (dirty)
+        {
+            dirty = purge = false;
+            dead = 0;
+            ++epoch;
+            entries.clear();
+            live.clear();
+            changed.clear();
+            engine.reset();
+            add(m, QModelIndex(), 0, m->rowCount() - 1);
+            return;
+        }
+
+        if (purge)
+        {
+            purge = false;
+            QVector<int> ids;
+            for (int id = 0; id < entries.size(); ++id)
+                if (live[id] && !entries[id].isValid()) ids.push_back(id);
+            kill(ids);
+        }
+
+        // 内容变化的行作废原来的行号，重新添加
+        if (changed.size())
+        {
+            QHash<QModelIndex, int> ids;
+            for (int id = 0; id < entries.size(); ++id)
+                if (live[id]) ids.insert(entries[id], id);
+            QVector<int> old;
+            QModelIndexList rows;
+            for (auto& c : changed)
+            {
+                auto it = ids.find(c);
+                if (it == ids.end()) continue;
+                old.push_back(*it);
+                rows.push_back(c);
+                ids.erase(it);
+            }
+            changed.clear();
+            kill(old);
+            append(m, rows);
+        }
+    }
+
+    void kill(const QVector<int>& ids)
+    {
+        if (ids.isEmpty()) return;
+        for (int id : ids) live[id] = false;
+        dead += ids.size();
+        engine.remove(ids);
+    }
+
+    // 添加parent下first到last行(含子节点)
+    void add(QAbstractItemModel *m, const QModelIndex& parent, int first, int last)
+    {
+        QModelIndexList rows;
+        collect(m, parent, first, last, rows);
+        append(m, rows);
+    }
+
+    void collect(QAbstractItemModel *m, const QModelIndex& parent, int first, int last, QModelIndexList& rows)
     {
-        if (!p) return;
-        QSet<QTreeWidgetItem*> set; // 匹配的行
-        for (auto i : p->findItems(text(), Qt::MatchContains))
-            set.insert(i);
-        QTreeWidgetItemIterator it(p);
-        while (*it)
+        for (int r = first; r <= last; ++r)
         {
-            auto i = *it++;
-            i->setHidden(!set.contains(i));
+            auto i = m->index(r, 0, parent);
+            rows.push_back(i);
+            if (m->hasChildren(i)) collect(m, i, 0, m->rowCount(i) - 1, rows);
         }
     }
 
-    void doFilter(QTableWidget *p)
+    void append(QAbstractItemModel *m, const QModelIndexList& rows)
     {
-        if (!p) return;
-        QSet<int> set; // 匹配的行
-        for (auto i : p->findItems(text(), Qt::MatchContains))
-            set.insert(i->row());
-        for (int i = 0; i < p->rowCount(); i++)
-            p->setRowHidden(i, !set.contains(i));
+        if (rows.isEmpty()) return;
+        for (auto& i : rows)
+        {
+            entries.push_back(i);
+            live.push_back(true);
+        }
+        if (auto src = dynamic_cast<FilterSource*>(m)) return engine.append(src->filterRows(rows));
+
+        // 模型不提供快照时在界面线程取文本
+        QVector<QVector<QByteArray>> cells;
+        for (auto& i : rows)
+        {
+            int cols = m->columnCount(i.parent());
+            QVector<QByteArray> row(cols);
+            for (int c = 0; c < cols; ++c)
+                row[c] = i.sibling(i.row(), c).data().toString().toLower().toUtf8();
+            cells.push_back(row);
+        }
+        engine.append([cells](QVector<QVector<QByteArray>>& out) { out = cells; });
     }
 
     void doFilter()
     {
-        doFilter(qobject_cast<QTableWidget*>(parent()));
-        doFilter(qobject_cast<QTreeWidget*>(parent()));
+        auto v = view();
+        if (!v || !v->model()) return;
+
+        auto m = v->model();
+        QStringList headers;
+        for (int c = 0; c < m->columnCount(); ++c)
+            headers.push_back(m->headerData(c, Qt::Horizontal).toString());
+        auto q = FilterQuery::parse(text(), headers);
+        if (q.isEmpty())
+        {
+            ++seq;
+            return apply(nullptr);
+        }
+
+        ensureIndex();
+        int id = ++seq;
+        int e = epoch;
+        Async::then(this, engine.query(q), [this, id, e](const QVector<int>& rows) {
+            if (id != seq) return;
+            if (e != epoch) return doFilter();
+            apply(&rows);
+        });
+    }
+
+    // rows为空指针时显示全部
+    void apply(const QVector<int> *rows)
+    {
+        QSet<QModelIndex> shown;
+        if (rows)
+        {
+            for (int id : *rows)
+            {
+                // 匹配行的上级节点也显示
+                if (!live[id]) continue;
+                for (QModelIndex i = entries[id]; i.isValid() && !shown.contains(i); i = i.parent())
+                    shown.insert(i);
+            }
+        }
+
+        auto v = view();
+        if (auto t = qobject_cast<QTableView*>(v))
+        {
+            auto m = t->model();
+            for (int r = 0; r < m->rowCount(); ++r)
+            {
+                bool hide = rows && !shown.contains(m->index(r, 0));
+                if (t->isRowHidden(r) != hide) t->setRowHidden(r, hide);
+            }
+        }
+        if (auto t = qobject_cast<QTreeView*>(v)) apply(t, QModelIndex(), rows ? &shown : nullptr);
+    }
+
+    void apply(QTreeView *t, const QModelIndex& parent, const QSet<QModelIndex> *shown)
+    {
+        auto m = t->model();
+        for (int r = 0; r < m->rowCount(parent); ++r)
+        {
+            auto i = m->index(r, 0, parent);
+            bool hide = shown && !shown->contains(i);
+            if (t->isRowHidden(r, parent) != hide) t->setRowHidden(r, parent, hide);
+            if (!hide && m->hasChildren(i)) apply(t, i, shown);
+        }
+    }
+
+    // 模型变化后若正在过滤，稍后重新过滤
+    void refilter()
+    {
+        if (text().size()) onChanged(text());
+    }
+
+    void invalidate()
+    {
+        dirty = true;
+        refilter();
+    }
+
+    void onRowsInserted(const QModelIndex& parent, int first, int last)
+    {
+        if (dirty) return;
+        add(view()->model(), parent, first, last);
+        refilter();
+    }
+
+    // 删除的行对应的持久索引已失效，查询前统一去掉
+    void onRowsRemoved()
+    {
+        purge = true;
+        refilter();
+    }
+
+    void onDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+    {
+        if (dirty) return;
+        for (int r = topLeft.row(); r <= bottomRight.row(); ++r)
+            changed.push_back(topLeft.sibling(r, 0));
+        // 不在过滤时变化会一直累积，超过行数后改为下次重建
+        if (changed.size() > entries.size()) dirty = true;
+        refilter();
     }
 
 public slots:
     void onChanged(const QString& text)
     {
+        // 查询走索引且在后台执行，间隔可以比较短
         if (timer) killTimer(timer);
-        timer = startTimer(500);
+        timer = startTimer(200);
     }
 
 protected:
@@ -159,6 +389,7 @@ protected:
     void timerEvent(QTimerEvent *event)
     {
         killTimer(timer);
+        timer = 0;
         doFilter();
     }
 
@@ -194,16 +425,20 @@ class QtAdb : public QMainWindow
 public:
 	QtAdb(QWidget *parent = Q_NULLPTR);
 
+    // 输出经LogSink按帧合并，行数有上限，过大的输出写入临时文件
     void log(const QString& text)
     {
-        ui.logEdit->appendPlainText(text);
+        logSink->append(text);
     }
 
-    //void log(QString text) { ui.logEdit->appendPlainText(text); }
-
     void log(const QStringList& list)
     {
-        for (auto& s : list) log(s);
+        logSink->append(list.join('\n'));
+    }
+
+    void log(const ShellResult& r)
+    {
+        logSink->append(static_cast<const QByteArray&>(r));
     }
 
     // 打印详细信息
@@ -211,67 +446,67 @@ public:
     {
         if (!checkDevice()) return;
 
+        auto f = cd->shellBatchAsync({
+            "getprop ro.product.model",
+            "getprop ro.build.version.release",
+            "getprop ro.product.name",
+            "wm size",
+        });
+        Async::then(this, f, [this](QList<ShellResult> r) { logBasicInfo(r); });
+    }
+
+    void logBasicInfo(QList<ShellResult>& r)
+    {
         log("[型号]");
-        log(cd->shell({ "getprop", "ro.product.model" }));
+        log(r[0]);
         log("[安卓版本]");
-        log(cd->shell({ "getprop", "ro.build.version.release" }) + cd->shell({ "getprop", "ro.product.name" }));
+        log(r[1] + r[2]);
         log("[分辨率]");
-        log(cd->shell({ "wm", "size" }));
+        log(r[3]);
     }
 
-    QString storageSize(float size)
+    void updatePsTree()
     {
-        const char *units[] = { "KB", "MB", "GB", "TB", nullptr };
-        int i = -1;
-        while (size > 1024) size /= 1024, ++i;
-        auto result = QString::number(size, 'g', 2);
-        if (i >= 0) result.append(' ').append(units[i]);
-        return result;
+        if (!checkDevice() || psPending == psGen) return;
+
+        // 解析和比较在后台完成，界面只应用变化
+        // 切换设备后代数增加，之前发出的请求不再占用，其结果也不再应用
+        int gen = psPending = psGen;
+        auto dev = cd;
+        auto prev = psModel->snapshot();
+        auto f = Async::run([dev, prev] {
+            return PsSnapshot::parse(dev->shell({ "ps", "-A", "-o", "NAME,PID,PPID,USER,VSZ,CMDLINE", "|", "tail", "-n", "+2"}), prev);
+        });
+        Async::then(this, f, [this, gen](const PsSnapshot& now) {
+            if (gen != psGen) return;
+            psPending = -1;
+            updatePsTree(now);
+        });
     }
 
-    void updatePsTree()
+    void updatePsTree(const PsSnapshot& now)
     {
-        if (!checkDevice()) return;
-
-        bool first = ui.treePs->topLevelItemCount() == 0;
-        for (auto line : cd->shell({ "ps", "-A", "-o", "NAME,PID,PPID,USER,VSZ,CMDLINE", "|", "tail", "-n", "+2"}))
-        {
-            LineParser p(std::move(line));
-            auto name = p.psname();
-            // 忽略线程
-            if (name[0] == '[') continue;
-
-            auto pid = p.next();
-            auto ppid = p.next().toInt();
-            auto user = p.next();
-            auto mem = p.next();
-            auto path = p.rest();
-
-            auto pid_ = pid.toInt();
-            auto item = psMap[pid_];
-            if (!item) item = new QTreeWidgetItem();
-
-            item->setText(0, name);
-            item->setText(1, pid);
-            item->setText(2, user);
-            item->setText(3, storageSize(mem.toFloat()));
-            item->setText(4, path);
-
-            auto parent = psMap[ppid];
-            if (parent)
-                parent->addChild(item);
-            else if (first)
-                ui.treePs->addTopLevelItem(item);
-            psMap.insert(pid_, item);
-        }
+        bool first = psModel->rowCount() == 0;
+        psModel->apply(now);
 
         if (first) ui.treePs->expandAll();
+        else for (int pid : now.diff.added) ui.treePs->expand(psModel->indexOf(pid));
+    }
+
+    // 进程列表自动刷新
+    void setPsAutoRefresh(bool on)
+    {
+        psTimer.setInterval(ui.spinPsInterval->value() * 1000);
+        if (on) psTimer.start();
+        else psTimer.stop();
     }
 
 public slots:
     void changeDevice(AdbDevice *dev)
     {
-        cd = dev; 
+        cd = dev;
+        ++psGen;
+        psModel->clear();       // 同时清空作为比较基准的上一次快照
         logBasicInfo();
         onTabChanged(ui.tabWidget->currentIndex());
     }
@@ -288,23 +523,35 @@ public slots:
     {
         if (!checkDevice()) return;
 
-        auto data = cd->shell({ "pm", "list", "package", "-f" }).split();
-        QRegExp reg(R"(package:(.+)=([^=]+)$)");
-        ui.appList->setRowCount(data.size());
-        for (int i = 0; i < data.size(); ++i)
+        auto dev = cd;
+        Async::then(this, cd->shellAsync({ "pm", "list", "package", "-f" }), [this, dev](const ShellResult& r) {
+            if (dev == cd) updateAppList(r);
+        });
+    }
+
+    // package:<路径>=<包名>
+    void updateAppList(const ShellResult& data)
+    {
+        appModel->beginReset(data);
+        for (auto line : data.lines())
         {
-            if (data[i].indexOf(reg) < 0)
+            int eq = line.lastIndexOf('=');
+            if (line.mid(0, 8) != "package:" || eq < 0)
             {
-                ui.appList->removeRow(i);
-                log("[warn] " + data[i]);
+                if (line.size()) log("[warn] " + line.toString());
                 continue;
             }
-
-            auto path = reg.cap(1);
-            auto package = reg.cap(2);
-            ui.appList->setItem(i, 0, new QTableWidgetItem(package));
-            ui.appList->setItem(i, 1, new QTableWidgetItem(path));
+            ByteView cells[] = { line.mid(eq + 1), line.mid(8, eq - 8) };
+            appModel->appendRow(cells);
         }
+        appModel->endReset();
+    }
+
+    // 应用列表当前行的包名
+    QString currentApp()
+    {
+        auto i = ui.appList->currentIndex();
+        return i.isValid() ? appModel->text(i.row(), 0) : QString();
     }
 
     void onTabChanged(int i)
@@ -318,17 +565,24 @@ public slots:
         {
             if (!ui.treeFs->topLevelItemCount()) updateDirs("/");
         }
+        // 屏幕只在可见时抓取
+        if (label == "屏幕") screenView->start(cd);
+        else screenView->stop();
+        // 日志切换到其他页后继续接收
+        if (label == "日志") logcatView->start(cd);
     }
     
     void uninstall()
     {
         // 当前焦点
-        auto app = ui.appList->item(ui.appList->currentRow(), 0)->text();
+        auto app = currentApp();
+        if (app.isEmpty()) return;
         if (QMessageBox::information(this, "卸载应用", app, QMessageBox::Yes | QMessageBox::No) == QMessageBox::Yes)
         {
-            auto r = cd->shell({ "pm", "uninstall", "--user", "0", app });
-            log("Uninstall " + app + " :" + r);
-            updateAppList();
+            Async::then(this, cd->shellAsync({ "pm", "uninstall", "--user", "0", app }), [this, app](const ShellResult& r) {
+                log("Uninstall " + app + " :" + r);
+                updateAppList();
+            });
         }
     }
 
@@ -341,33 +595,87 @@ public slots:
     {
         if (!checkDevice()) return;
 
-        auto app = ui.appList->item(ui.appList->currentRow(), 0)->text();
-        auto act = cd->shell({ "dumpsys package " + app + " | awk '/android.intent.action.MAIN:/ { getline; print $2 }'" }).split();
-        if (act.size()) log(cd->shell({ "am", "start", act[0] }));
+        auto app = currentApp();
+        if (app.isEmpty()) return;
+        auto dev = cd;
+        auto f = Async::run([dev, app] {
+            auto act = dev->shell({ "dumpsys package " + app + " | awk '/android.intent.action.MAIN:/ { getline; print $2 }'" }).split();
+            return act.size() ? dev->shell({ "am", "start", act[0] }) : ShellResult();
+        });
+        Async::then(this, f, [this](const ShellResult& r) { if (r.size()) log(r); });
     }
 
     // 输入文本
     void inputText()
     {
         if (!checkDevice()) return;
-        cd->shell({ "input", "text", ui.lineInputText->text() });
+        auto dev = cd;
+        auto text = ui.lineInputText->text();
+        Async::run([dev, text] { dev->inject([&](InputInjector& in) { in.text(text); }); });
+    }
+
+    // 在所有设备上并行执行，每台设备完成后输出结果
+    void fanOut(const FanOut::Task& task)
+    {
+        fanOut(task, comboDevice->allDevices());
+    }
+
+    void fanOut(const FanOut::Task& task, const QList<AdbDevice*>& devs)
+    {
+        auto f = new FanOut(this);
+        connect(f, &FanOut::deviceFinished, this, [this](const FanOut::Result& r) {
+            log(QString("[%1] %2 %3 ms").arg(r.device, r.ok ? "OK" : "FAIL").arg(r.ms));
+            if (r.output.size()) log(r.output);
+        });
+        connect(f, &FanOut::finished, this, [this, f] {
+            log(f->summary());
+            f->deleteLater();
+        });
+        f->run(devs, task);
+    }
+
+    // 执行自动化脚本，勾选所有设备时各设备并行执行
+    void runScript()
+    {
+        if (!checkDevice()) return;
+        auto file = QFileDialog::getOpenFileName(this, "运行脚本", QString(), "JavaScript (*.js);;所有文件 (*)");
+        if (file.isEmpty()) return;
+        QFile f(file);
+        if (!f.open(QIODevice::ReadOnly))
+        {
+            log("[脚本] " + f.errorString());
+            return;
+        }
+
+        log("[脚本] " + file);
+        auto task = ScriptRunner::task(QString::fromUtf8(f.readAll()), QFileInfo(file).fileName());
+        if (ui.checkAllDevices->isChecked()) fanOut(task);
+        else fanOut(task, { cd });
     }
 
     void execActionCommand()
     {
         if (!checkDevice()) return;
-        auto app = ui.appList->item(ui.appList->currentRow(), 0)->text();
+        auto app = currentApp();
+        if (app.isEmpty()) return;
         auto a = (QAction*)sender();
         log("[" + a->text() + ": " + app + "]");
-        log(cd->shell({ a->toolTip(), app}));
+        if (ui.checkAllDevices->isChecked())
+            return fanOut(FanOut::shell(a->toolTip() + " " + app));
+        Async::then(this, cd->shellAsync({ a->toolTip(), app }), [this](const ShellResult& r) { log(r); });
     }
 
     void execShellCommand(QString cmd)
     {
+        if (ui.checkAllDevices->isChecked())
+        {
+            log("$ " + cmd);
+            return fanOut(FanOut::shell(cmd));
+        }
         if (!checkDevice()) return;
 
         log("$ " + cmd);
-        log(cd->shell({ cmd }));
+        Async::then(this, cd->shellAsync({ cmd }), [this](const ShellResult& r) { log(r); });
     }
 
     void onCommandDblClicked(QTableWidgetItem *item)
@@ -375,28 +683,35 @@ public slots:
         execShellCommand(item->text());
     }
 
-    ShellResult ls(const QString& dir)
-    {
-        return cd->shell({ "ls -lh " + dir + " | awk 'NR>1{sub(/, +/,\",\");print}'" });
-    }
-
     static QStringList getPath(QTreeWidgetItem *item);
 
-    void onFileExpanded(QTreeWidgetItem *item)
+    // 目录节点对应的路径，以'/'结尾
+    static QString dirPath(QTreeWidgetItem *item)
     {
         QStringList path = getPath(item);
         path.front() = "";
         path.push_back("");
+        return path.join("/");
+    }
 
-        if (0 == item->childCount())
-        {
-            updateDirs(path.join("/"), item);
-        }
+    void onFileExpanded(QTreeWidgetItem *item)
+    {
+        // 正在列举的目录不重复请求，列举过的从缓存中取
+        if (!item->data(0, Qt::UserRole).toBool()) updateDirs(dirPath(item), item);
     }
 
     void onFileItemChanged(QTreeWidgetItem *item, QTreeWidgetItem *old)
     {
-        onFileExpanded(item);
+        if (item) onFileExpanded(item);
+    }
+
+    // 重新读取当前目录
+    void refreshDir()
+    {
+        auto item = ui.treeFs->currentItem();
+        if (!checkDevice() || !item) return;
+        cd->invalidateDir(dirPath(item));
+        updateDirs(dirPath(item), item);
     }
 
     void updateDirs(const QString& dir, QTreeWidgetItem *parent = nullptr)
@@ -414,61 +729,190 @@ public slots:
             return updateDirs("/", parent);
         }
 
-        QRegExp deli("\\s+");
-        auto data = ls(dir).split();
-        ui.tableFs->setRowCount(data.size());
-        for (int i = 0; data.size(); ++i)
+        // 缓存中有的先显示，过期的再到后台重新读取
+        auto dev = cd;
+        fsWant = dir;
+        QVector<AdbSync::Entry> cached;
+        bool fresh = dev->cachedDir(dir, cached);
+        if (fresh || cached.size()) showDir(dir, cached, parent);
+        if (fresh) return;
+
+        // 等待期间节点可能因上级目录刷新被删除，回来后按路径重新查找
+        parent->setData(0, Qt::UserRole, true);
+        Async::then(this, dev->listDirAsync(dir, true), [this, dev, dir](const QVector<AdbSync::Entry>& list) {
+            auto item = dirItem(dir);
+            if (!item) return;
+            item->setData(0, Qt::UserRole, false);
+            if (dev == cd && dir == fsWant) showDir(dir, list, item);
+        });
+    }
+
+    QTreeWidgetItem *dirItem(const QString& dir)
+    {
+        auto item = ui.treeFs->topLevelItem(0);
+        for (auto& name : dir.split('/', QString::SkipEmptyParts))
+        {
+            QTreeWidgetItem *next = nullptr;
+            for (int i = 0; item && i < item->childCount() && !next; ++i)
+                if (item->child(i)->text(0) == name) next = item->child(i);
+            item = next;
+        }
+        return item;
+    }
+
+    // 文件图标的类型，与fsModel的图标顺序一致
+    enum { FsFile, FsDir, FsFileLink, FsDirLink };
+
+    void showDir(const QString& dir, const QVector<AdbSync::Entry>& list, QTreeWidgetItem *parent)
+    {
+        enum { Cols = 7 };
+        fsDir = dir;
+
+        // 各列文本连续存放，表格模型只记录位置
+        QByteArray buf;
+        QVector<QPair<int, int>> pos;
+        auto add = [&](const QByteArray& v) { pos.push_back({ buf.size(), v.size() }); buf += v; };
+        for (auto& e : list)
+        {
+            add(e.name.toUtf8());
+            add(e.perms().toUtf8());
+            add(e.hasOwner ? AdbSync::idName(e.uid).toUtf8() : QByteArray());
+            add(e.hasOwner ? AdbSync::idName(e.gid).toUtf8() : QByteArray());
+            add(QByteArray::number(e.size));
+            add(QDateTime::fromSecsSinceEpoch(e.mtime).toString("yyyy-MM-dd hh:mm").toUtf8());
+            add(e.link.toUtf8());
+        }
+        ShellResult data(std::move(buf));
+
+        // 子目录有变化时才重建树节点，保留已展开的子树
+        QStringList dirs, children;
+        for (auto& e : list)
+            if (e.isDir() || e.linkDir) dirs.push_back(e.name);
+        for (int i = 0; i < parent->childCount(); ++i)
+            children.push_back(parent->child(i)->text(0));
+        bool fill = dirs != children;
+        if (fill) qDeleteAll(parent->takeChildren());
+
+        auto style = QApplication::style();
+        fsModel->beginReset(data);
+        for (int i = 0; i < list.size(); ++i)
         {
-            LineParser p(std::move(data.takeFirst()));
-
-            auto flags = p.next();
-            p.next();
-            auto user = p.next();
-            auto group = p.next();
-            auto size = p.next();
-            p.next();
-            p.next();
-            auto name = p.next();
-            p.next();
-            auto link = p.next();
-
-            auto file = new QTableWidgetItem(name);
-            ui.tableFs->setItem(i, 0, file);
-            ui.tableFs->setItem(i, 1, new QTableWidgetItem(flags));
-            ui.tableFs->setItem(i, 2, new QTableWidgetItem(user));
-            ui.tableFs->setItem(i, 3, new QTableWidgetItem(group));
-            ui.tableFs->setItem(i, 4, new QTableWidgetItem(size));
-
-            auto item = new QTreeWidgetItem();
-            item->setText(0, name);
-
-            bool isDir = false;
-            bool isLink = false;
-            if (flags[0] == 'l' && link.size())
-                isLink = true, isDir = size == "11";
-            else if (flags[0] == 'd') isDir = true;
-
-            ui.tableFs->setItem(i, 4, new QTableWidgetItem(size));
-            ui.tableFs->setItem(i, 5, new QTableWidgetItem(isLink ? link: ""));
-            if (isDir)
+            auto& e = list[i];
+            bool isDir = e.isDir() || e.linkDir;
+
+            ByteView cells[Cols];
+            for (int c = 0; c < Cols; ++c)
+                cells[c] = ByteView(data.constData() + pos[i * Cols + c].first, pos[i * Cols + c].second);
+            fsModel->appendRow(cells, e.isLink() ? (isDir ? FsDirLink : FsFileLink) : (isDir ? FsDir : FsFile));
+
+            if (isDir && fill)
             {
-                if (parent) parent->addChild(item);
-                auto icon = style->standardIcon(isLink ? QStyle::SP_DirLinkIcon : QStyle::SP_DirIcon);
-                file->setIcon(icon), item->setIcon(0, icon);
+                auto item = new QTreeWidgetItem();
+                item->setText(0, e.name);
+                item->setIcon(0, style->standardIcon(e.isLink() ? QStyle::SP_DirLinkIcon : QStyle::SP_DirIcon));
                 item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
-            }
-            else
-            {
-                auto icon = style->standardIcon(isLink ? QStyle::SP_FileLinkIcon : QStyle::SP_FileIcon);
-                file->setIcon(icon), item->setIcon(0, icon);
+                parent->addChild(item);
             }
         }
+        fsModel->endReset();
         parent->setExpanded(true);
+
+        // 预读下一级，进入子目录时直接从缓存显示
+        QStringList next;
+        for (auto& d : dirs.mid(0, 32)) next.push_back(dir + d + '/');
+        if (next.size()) cd->prefetchDirsAsync(next);
     }
 
-    void onPsTreeItemDoubleClicked(QTreeWidgetItem *item)
+    // 下载文件列表中选中的文件和目录
+    void pullFiles()
     {
-        auto dlg = new PsDlg(this, cd, item->text(1).toInt());
+        if (!checkDevice() || fsDir.isEmpty()) return;
+        auto rows = ui.tableFs->selectionModel()->selectedRows();
+        if (rows.isEmpty()) return;
+        auto local = QFileDialog::getExistingDirectory(this, "下载到");
+        if (local.isEmpty()) return;
+
+        auto t = new FileTransfer(cd, this);
+        for (auto& i : rows)
+        {
+            int k = fsModel->kind(i.row());
+            t->pull(fsDir + fsModel->text(i.row(), 0), local, k == FsDir || k == FsDirLink);
+        }
+        runTransfer(t);
+    }
+
+    // 上传本地文件到当前目录
+    void pushFiles()
+    {
+        if (!checkDevice() || fsDir.isEmpty()) return;
+        auto files = QFileDialog::getOpenFileNames(this, "上传到 " + fsDir);
+        if (files.isEmpty()) return;
+
+        auto t = new FileTransfer(cd, this);
+        for (auto& f : files) t->push(f, fsDir);
+        auto dev = cd;
+        auto dir = fsDir;
+        connect(t, &FileTransfer::finished, this, [dev, dir] { dev->invalidateDir(dir); });
+        runTransfer(t);
+    }
+
+    // 本地目录同步到当前目录下的同名目录，只上传大小或时间不同的文件
+    void syncFolder()
+    {
+        if (!checkDevice() || fsDir.isEmpty()) return;
+        auto local = QFileDialog::getExistingDirectory(this, "同步到 " + fsDir);
+        if (local.isEmpty()) return;
+        bool hash = QMessageBox::question(this, "同步文件夹", "大小相同而修改时间不同的文件，是否比较md5？")
+            == QMessageBox::Yes;
+
+        auto dev = cd;
+        auto remote = fsDir + QFileInfo(local).fileName();
+        auto f = Async::run([=] { return FolderSync::plan(dev, local, remote, hash); });
+        Async::then(this, f, [=](const FolderSync::Plan& plan) {
+            log(QString("[同步] %1 -> %2: %3 个文件未变化, %4 个文件需要上传 (%5)")
+                .arg(local, remote).arg(plan.unchanged).arg(plan.files.size()).arg(storageSize(plan.bytes / 1024.0f)));
+            if (plan.files.isEmpty()) return;
+
+            auto t = new FileTransfer(dev, this);
+            QDir base(local);
+            for (auto& rel : plan.files)
+            {
+                int slash = rel.lastIndexOf('/');
+                t->push(base.filePath(rel), slash < 0 ? remote : remote + '/' + rel.left(slash));
+            }
+            auto dir = fsDir;
+            connect(t, &FileTransfer::finished, this, [dev, dir, remote] {
+                dev->invalidateDir(dir);
+                dev->invalidateDir(remote, true);
+            });
+            runTransfer(t);
+        });
+    }
+
+    void runTransfer(FileTransfer *t)
+    {
+        connect(t, &FileTransfer::progress, this, [this](qint64 done, qint64 total, int files, int totalFiles, double rate) {
+            statusBar()->showMessage(QString("传输 %1/%2 个文件, %3 / %4, %5/s")
+                .arg(files).arg(totalFiles).arg(storageSize(done / 1024.0f))
+                .arg(storageSize(total / 1024.0f)).arg(storageSize(rate / 1024)));
+        });
+        connect(t, &FileTransfer::fileFailed, this, [this](const QString& path, const QString& err) {
+            log("[传输失败] " + path + ": " + err);
+        });
+        connect(t, &FileTransfer::finished, this, [this, t] {
+            log(t->summary());
+            statusBar()->clearMessage();
+            t->deleteLater();
+        });
+        t->start();
+    }
+
+    void onPsTreeDblClicked(const QModelIndex& i)
+    {
+        int pid = psModel->pid(i);
+        if (!pid) return;
+        auto dlg = new PsDlg(this, cd, pid);
+        dlg->setAttribute(Qt::WA_DeleteOnClose);    // 关闭时停止采样
         dlg->setModal(true);
         dlg->show();
     }
@@ -477,7 +921,17 @@ private:
 	Ui::QtAdbClass ui;
 
     DeviceComboBox *comboDevice;
-    QHash<int, QTreeWidgetItem*> psMap;
+    ScreenView *screenView;
+    LogcatView *logcatView;
+    LogSink *logSink;
+    ColumnTableModel *appModel;
+    ColumnTableModel *fsModel;
+    ProcessModel *psModel;
+    QString fsDir;              // 文件列表当前显示的目录，以'/'结尾
+    QString fsWant;             // 最近一次请求显示的目录
+    QTimer psTimer;
+    int psGen = 0;              // 进程列表的代数，切换设备时增加
+    int psPending = -1;         // 正在获取的进程列表所属的代数
     AdbDevice *cd = nullptr;
     QActionGroup *devGroup = new QActionGroup(this);
 };
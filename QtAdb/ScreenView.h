@@ -0,0 +1,311 @@
+#pragma once
+
+#include <QWidget>
+#include <QImage>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+
+#include "InputInjector.h"
+#include "Screencap.h"
+
+// 实时屏幕
+// 一条exec连接上循环执行screencap，每发一个换行取一帧原始像素(不压缩成PNG)，帧率由本机控制；
+// 与上一帧按块比较，只重绘有变化的块；界面直接用接收缓冲区构造QImage，不再拷贝和转换整帧
+// 点击映射为tap，拖动映射为swipe
+class ScreenView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    ScreenView(QWidget *parent): QWidget(parent)
+    {
+        setAttribute(Qt::WA_OpaquePaintEvent);
+        setMinimumSize(160, 160);
+    }
+
+    ~ScreenView() { stop(); }
+
+    void setFps(int fps) { this->fps.storeRelease(qBound(1, fps, 60)); }
+
+    // 开始显示某台设备，已在显示时不重复启动
+    void start(AdbDevice *dev)
+    {
+        if (dev == this->dev && worker.isRunning()) return;
+        stop();
+        this->dev = dev;
+        if (!dev) return;
+        token = CancelToken();
+        pending.storeRelease(0);
+        worker = Async::run([this, dev, token = token] { capture(dev, token); });
+    }
+
+    // 关闭后台线程正在读取的连接，不必等到读取超时，切换页面或设备时界面不会卡住
+    void stop()
+    {
+        token.cancel();
+        {
+            QMutexLocker lock(&sockLock);
+            if (sock) sock->shutdown();
+        }
+        worker.waitForFinished();
+    }
+
+    // 统计: 最近一帧的变化块数/总块数
+    int dirtyTiles() const { return lastDirty; }
+    int totalTiles() const { return lastTotal; }
+
+Q_SIGNALS:
+    void frameShown(int dirty, int total);
+
+protected:
+    void paintEvent(QPaintEvent *e) override
+    {
+        QPainter p(this);
+        auto target = fit();
+        if (image.isNull())
+        {
+            p.fillRect(rect(), Qt::black);
+            return;
+        }
+
+        // 只转换、绘制需要重绘的部分
+        for (auto& r : e->region())
+        {
+            auto dst = r & target;
+            if (!dst.isEmpty()) p.drawImage(dst, image, toImage(dst));
+        }
+        for (auto& r : e->region() - target) p.fillRect(r, Qt::black);
+    }
+
+    void mousePressEvent(QMouseEvent *e) override
+    {
+        pressPos = e->pos();
+        pressTime.start();
+    }
+
+    void mouseReleaseEvent(QMouseEvent *e) override
+    {
+        if (image.isNull() || !dev) return;
+        auto a = toDevice(pressPos), b = toDevice(e->pos());
+        if (!fit().contains(pressPos)) return;
+
+        auto d = dev;
+        int ms = int(qBound<qint64>(50, pressTime.elapsed(), 2000));
+        if ((e->pos() - pressPos).manhattanLength() < 8)
+            Async::run([=] { d->inject([&](InputInjector& in) { in.tap(a.x(), a.y(), ms > 500 ? ms : 40); }); });
+        else
+            Async::run([=] { d->inject([&](InputInjector& in) { in.swipe(a.x(), a.y(), b.x(), b.y(), ms); }); });
+    }
+
+private:
+    enum { Tile = 64 };
+
+    struct Frame
+    {
+        QByteArray data;
+        int width = 0, height = 0, bpp = 4;
+        QImage::Format format = QImage::Format_RGBA8888;
+    };
+
+    // 在作用域内把连接登记为正在读取，stop()可以关闭它；已取消时不登记，转换为false
+    class Reading
+    {
+    public:
+        Reading(ScreenView *v, AdbSocket& s, const CancelToken& token): v(v)
+        {
+            QMutexLocker lock(&v->sockLock);
+            if (!token.cancelled()) v->sock = &s;
+            ok = v->sock == &s;
+        }
+
+        ~Reading()
+        {
+            QMutexLocker lock(&v->sockLock);
+            v->sock = nullptr;
+        }
+
+        explicit operator bool() const { return ok; }
+
+    private:
+        ScreenView *v;
+        bool ok;
+    };
+
+    // 保持比例居中
+    QRect fit() const
+    {
+        if (image.isNull()) return rect();
+        auto s = image.size().scaled(size(), Qt::KeepAspectRatio);
+        return QRect(QPoint((width() - s.width()) / 2, (height() - s.height()) / 2), s);
+    }
+
+    QRect toImage(const QRect& r) const
+    {
+        auto t = fit();
+        if (t.isEmpty()) return QRect();
+        double sx = double(image.width()) / t.width(), sy = double(image.height()) / t.height();
+        return QRectF((r.x() - t.x()) * sx, (r.y() - t.y()) * sy, r.width() * sx, r.height() * sy)
+            .toAlignedRect() & image.rect();
+    }
+
+    QRect toWidget(const QRect& r) const
+    {
+        auto t = fit();
+        double sx = double(t.width()) / image.width(), sy = double(t.height()) / image.height();
+        return QRectF(t.x() + r.x() * sx, t.y() + r.y() * sy, r.width() * sx, r.height() * sy).toAlignedRect();
+    }
+
+    QPoint toDevice(const QPoint& p) const
+    {
+        auto t = fit();
+        return QPoint(int(qint64(p.x() - t.x()) * image.width() / qMax(1, t.width())),
+                      int(qint64(p.y() - t.y()) * image.height() / qMax(1, t.height())));
+    }
+
+    // 界面线程: 用接收缓冲区构造图像，标记变化的区域
+    void show(const Frame& f, const QVector<QRect>& dirty, int total)
+    {
+        pending.storeRelease(0);
+        bool resized = f.width != image.width() || f.height != image.height();
+        frame = f;
+        image = QImage((const uchar*)frame.data.constData(), f.width, f.height,
+                       f.width * f.bpp, f.format);
+        lastDirty = dirty.size();
+        lastTotal = total;
+
+        if (resized) update();
+        else
+        {
+            QRegion r;
+            for (auto& d : dirty) r += toWidget(d).adjusted(-1, -1, 1, 1);
+            update(r);
+        }
+        emit frameShown(lastDirty, lastTotal);
+    }
+
+    // 后台线程: 取帧、比较、交给界面
+    void capture(AdbDevice *dev, CancelToken token)
+    {
+        // Android 8起头部多了4字节的色彩空间，厂商系统不一定与版本号对应，按实际输出判断
+        int header = 0;
+        {
+            AdbSocket probe;
+            if (!Screencap::open(dev, probe)) return;
+            Reading r(this, probe, token);
+            if (r) header = Screencap::headerSize(probe);
+        }
+        if (!header) return;
+        AdbSocket s;
+        if (!AdbClient::open(s, dev->name, "exec:while read l; do screencap; done")) return;
+        Reading r(this, s, token);
+        if (!r) return;
+        s.setBufferSize(4 * 1024 * 1024);
+        s.setTimeout(10 * 1000);
+
+        Frame prev;
+        QByteArray spare;
+        while (!token.cancelled())
+        {
+            QElapsedTimer t;
+            t.start();
+            if (!s.write("\n", 1)) return;
+
+            char h[16];
+            if (!s.readFully(h, header)) return;
+            Frame f;
+            f.width = qFromLittleEndian<qint32>(h);
+            f.height = qFromLittleEndian<qint32>(h + 4);
+            if (!Screencap::format(qFromLittleEndian<qint32>(h + 8), f.format, f.bpp) || f.width <= 0 || f.height <= 0) return;
+
+            // 界面仍持有的缓冲区不能覆盖，否则复用上上帧的
+            int size = f.width * f.height * f.bpp;
+            if (spare.size() != size || !spare.isDetached()) spare = QByteArray(size, Qt::Uninitialized);
+            f.data = spare;
+            spare.clear();
+            if (!s.readFully(f.data.data(), size)) return;
+
+            // 界面还没处理完上一帧时丢弃这一帧
+            if (pending.loadAcquire() == 0)
+            {
+                int total = 0;
+                auto dirty = diff(prev, f, total);
+                if (dirty.size())
+                {
+                    pending.storeRelease(1);
+                    QMetaObject::invokeMethod(this, [this, f, dirty, total] { show(f, dirty, total); }, Qt::QueuedConnection);
+                    spare = prev.data;
+                    prev = f;
+                }
+                else spare = f.data;
+            }
+            else spare = f.data;
+
+            int wait = 1000 / fps.loadAcquire() - int(t.elapsed());
+            for (; wait > 0 && !token.cancelled(); wait -= 50)
+                QThread::msleep(ulong(qMin(wait, 50)));
+        }
+    }
+
+    // 按Tile×Tile分块比较，同一行相邻的变化块合并成一个矩形
+    static QVector<QRect> diff(const Frame& a, const Frame& b, int& total)
+    {
+        int cols = (b.width + Tile - 1) / Tile, rows = (b.height + Tile - 1) / Tile;
+        total = cols * rows;
+        QVector<QRect> out;
+        if (a.width != b.width || a.height != b.height || a.bpp != b.bpp)
+        {
+            out.push_back(QRect(0, 0, b.width, b.height));
+            return out;
+        }
+
+        int stride = b.width * b.bpp;
+        auto pa = a.data.constData(), pb = b.data.constData();
+        QVector<bool> dirty(cols);
+        for (int ty = 0; ty < rows; ++ty)
+        {
+            dirty.fill(false);
+            int y0 = ty * Tile, y1 = qMin(y0 + Tile, b.height);
+            for (int y = y0; y < y1; ++y)
+            {
+                auto ra = pa + y * stride, rb = pb + y * stride;
+                // 整行相同是最常见的情况，先整行比较
+                if (memcmp(ra, rb, stride) == 0) continue;
+                for (int tx = 0; tx < cols; ++tx)
+                {
+                    if (dirty[tx]) continue;
+                    int x0 = tx * Tile * b.bpp, n = qMin(Tile * b.bpp, stride - x0);
+                    if (memcmp(ra + x0, rb + x0, n) != 0) dirty[tx] = true;
+                }
+            }
+
+            for (int tx = 0; tx < cols; )
+            {
+                if (!dirty[tx]) { ++tx; continue; }
+                int e = tx;
+                while (e < cols && dirty[e]) ++e;
+                out.push_back(QRect(tx * Tile, y0, qMin(e * Tile, b.width) - tx * Tile, y1 - y0));
+                tx = e;
+            }
+        }
+        return out;
+    }
+
+    AdbDevice *dev = nullptr;
+    QFuture<void> worker;
+    CancelToken token;
+    QMutex sockLock;
+    AdbSocket *sock = nullptr;      // 后台线程正在读取的连接
+    QAtomicInt fps = 10;
+    QAtomicInt pending;         // 已交给界面、尚未显示的帧
+
+    Frame frame;                // 当前显示的帧，image引用其中的数据
+    QImage image;
+    int lastDirty = 0, lastTotal = 0;
+
+    QPoint pressPos;
+    QElapsedTimer pressTime;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QImage>
+
+#include "AdbDevice.h"
+
+// screencap 原始输出: 宽(4) 高(4) 格式(4) [色彩空间(4)，Android 8起] + 逐行像素
+struct Screencap
+{
+    // android PixelFormat 对应的QImage格式和每像素字节数
+    static bool format(int f, QImage::Format& fmt, int& bpp)
+    {
+        switch (f)
+        {
+        case 1: fmt = QImage::Format_RGBA8888, bpp = 4; return true;
+        case 2: fmt = QImage::Format_RGBX8888, bpp = 4; return true;
+        case 3: fmt = QImage::Format_RGB888, bpp = 3; return true;
+        case 4: fmt = QImage::Format_RGB16, bpp = 2; return true;
+        case 5: fmt = QImage::Format_ARGB32, bpp = 4; return true;     // BGRA，小端下即ARGB32
+        default: return false;
+        }
+    }
+
+    // 由一帧完整输出的总长度推出头部长度，不必查询系统版本，无法解析时返回0
+    static int parse(const QByteArray& data, int& w, int& h, QImage::Format& fmt, int& bpp)
+    {
+        if (data.size() < 12) return 0;
+        w = qFromLittleEndian<qint32>(data.constData());
+        h = qFromLittleEndian<qint32>(data.constData() + 4);
+        if (w <= 0 || h <= 0 || !format(qFromLittleEndian<qint32>(data.constData() + 8), fmt, bpp)) return 0;
+
+        qint64 header = data.size() - qint64(w) * h * bpp;
+        return header == 12 || header == 16 ? int(header) : 0;
+    }
+
+    static bool open(AdbDevice *dev, AdbSocket& s)
+    {
+        if (!AdbClient::open(s, dev->name, "exec:screencap")) return false;
+        s.setBufferSize(4 * 1024 * 1024);
+        return true;
+    }
+
+    static QByteArray capture(AdbDevice *dev)
+    {
+        AdbSocket s;
+        if (!open(dev, s)) return QByteArray();
+        bool ok;
+        auto data = s.readToEnd(&ok);
+        return ok ? data : QByteArray();
+    }
+
+    // 截取一帧，返回的图像直接引用data中的像素，data须在使用期间保持不变
+    static QImage grab(AdbDevice *dev, QByteArray& data)
+    {
+        data = capture(dev);
+        int w, h, bpp;
+        QImage::Format fmt;
+        int header = parse(data, w, h, fmt, bpp);
+        if (!header) return QImage();
+        return QImage((const uchar*)data.constData() + header, w, h, w * bpp, fmt);
+    }
+
+    // 连续截屏时每帧之间没有分隔，先在open打开的连接上单独截取一帧得到头部长度
+    static int headerSize(AdbSocket& s)
+    {
+        bool ok;
+        auto data = s.readToEnd(&ok);
+        int w, h, bpp;
+        QImage::Format fmt;
+        return ok ? parse(data, w, h, fmt, bpp) : 0;
+    }
+};
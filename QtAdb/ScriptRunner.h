@@ -0,0 +1,308 @@
+#pragma once
+
+#include <QObject>
+#include <QJSEngine>
+#include <QJSValue>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMap>
+#include <algorithm>
+
+#include "FanOut.h"
+#include "InputInjector.h"
+#include "UiHierarchy.h"
+#include "TemplateMatcher.h"
+
+// 自动化脚本(JavaScript)，每台设备在FanOut的工作线程中各用一个QJSEngine执行
+// 脚本中的 dev 对象提供点击、等待等操作，每次调用都记录耗时，结束后按步骤汇总
+//  dev.startApp("com.app/.MainActivity")
+//  dev.waitActivity("com.app.MainActivity", 10000)
+//  dev.click("登录")                      // 按文本等待并点击
+//  dev.click({ rc: "com.app:id/ok" })     // 定位条件: text / cls / rc
+//  dev.tap(100, 200); dev.swipe(500, 1500, 500, 500, 300); dev.key("KEYCODE_BACK")
+//  var b = dev.find("//Button[@text='确定']")   // 类XPath查询，返回 {left, top, right, bottom} 或 null
+//  dev.findImage("start.png", 0.85, [0, 0.5, 1, 1])  // 图片定位，可限定范围 [x1, y1, x2, y2](比例)
+class ScriptApi : public QObject
+{
+    Q_OBJECT
+
+public:
+    // 每次调用的记录
+    struct Step
+    {
+        QString name;
+        QString arg;
+        qint64 ms = 0;
+        bool ok = true;
+    };
+
+    ScriptApi(AdbDevice *dev, QJSEngine *engine, const CancelToken& token, QString& out)
+        : dev(dev), injector(dev), engine(engine), token(token), out(out) {}
+
+    const QVector<Step>& steps() const { return list; }
+
+    // 执行攒下的按键和文字，记为一步；其他操作开始前和脚本结束时调用
+    bool flush()
+    {
+        if (!injector.size() || token.cancelled()) return true;
+        Step s;
+        s.name = "input";
+        s.arg = QString::number(injector.size());
+        QElapsedTimer clock;
+        clock.start();
+        s.ok = injector.run(token);
+        s.ms = clock.elapsed();
+        list.push_back(s);
+        return s.ok;
+    }
+
+    Q_INVOKABLE QString serial() const { return dev->name; }
+
+    Q_INVOKABLE void log(const QString& text) { out += text + '\n'; }
+
+    Q_INVOKABLE void sleep(int ms)
+    {
+        Timer t(this, "sleep", QString::number(ms));
+        for (; ms > 0 && !token.cancelled(); ms -= 50)
+            QThread::msleep(ulong(qMin(ms, 50)));
+    }
+
+    Q_INVOKABLE QString shell(const QString& cmd)
+    {
+        Timer t(this, "shell", cmd);
+        if (!t.run()) return QString();
+        return dev->shell({ cmd });
+    }
+
+    Q_INVOKABLE void startApp(const QString& pkgAct)
+    {
+        Timer t(this, "startApp", pkgAct);
+        if (t.run()) dev->start_app(pkgAct);
+    }
+
+    Q_INVOKABLE QString activity()
+    {
+        Timer t(this, "activity");
+        return t.run() ? dev->activity() : QString();
+    }
+
+    Q_INVOKABLE bool waitActivity(const QString& name, int ms = 30 * 1000)
+    {
+        Timer t(this, "waitActivity", name);
+        return t.run() && t.ok(dev->wait_activity(name, ms, token));
+    }
+
+    Q_INVOKABLE QJSValue waitCtrl(const QJSValue& locator, int ms = 30 * 1000)
+    {
+        auto l = ctrl(locator);
+        Timer t(this, "waitCtrl", describe(l));
+        if (!t.run()) return QJSValue::NullValue;
+        return bounds(t, dev->wait_ctrl(l, ms, token));
+    }
+
+    Q_INVOKABLE QJSValue click(const QJSValue& locator, int ms = 30 * 1000)
+    {
+        auto l = ctrl(locator);
+        Timer t(this, "click", describe(l));
+        if (!t.run()) return QJSValue::NullValue;
+        auto b = dev->wait_ctrl(l, ms, token);
+        if (b) t.ok(injector.tap(b).run(token));
+        return bounds(t, b);
+    }
+
+    Q_INVOKABLE QJSValue find(const QString& xpath)
+    {
+        Timer t(this, "find", xpath);
+        if (!t.run()) return QJSValue::NullValue;
+        auto h = UiHierarchy::capture(dev);
+        int i = h.queryFirst(xpath);
+        return bounds(t, i >= 0 ? h.node(i).bounds : AdbDevice::CtrlBound());
+    }
+
+    Q_INVOKABLE QJSValue findImage(const QString& file, double threshold = 0.85, const QJSValue& area = QJSValue())
+    {
+        Timer t(this, "findImage", file);
+        if (!t.run()) return QJSValue::NullValue;
+        auto& m = matcher(file);
+        if (m.isNull())
+        {
+            engine->throwError("cannot load image: " + file);
+            return QJSValue::NullValue;
+        }
+
+        Region r;
+        if (area.isArray())
+        {
+            r.x1 = float(area.property(0).toNumber()), r.y1 = float(area.property(1).toNumber());
+            r.x2 = float(area.property(2).toNumber()), r.y2 = float(area.property(3).toNumber());
+        }
+        return bounds(t, m.find(dev, r, threshold).bound);
+    }
+
+    // 点击和滑动连同之前攒下的按键、文字一起执行
+    Q_INVOKABLE void tap(int x, int y)
+    {
+        Timer t(this, "tap", QString("%1,%2").arg(x).arg(y), false);
+        if (t.run()) t.ok(injector.tap(x, y).run(token));
+    }
+
+    Q_INVOKABLE void swipe(int x1, int y1, int x2, int y2, int ms = 300)
+    {
+        Timer t(this, "swipe", QString("%1,%2 -> %3,%4").arg(x1).arg(y1).arg(x2).arg(y2), false);
+        if (t.run()) t.ok(injector.swipe(x1, y1, x2, y2, ms).run(token));
+    }
+
+    // 连续的按键和文字合并成一条shell命令，到下一个其他操作时才执行
+    Q_INVOKABLE void key(const QString& code)
+    {
+        Timer t(this, "key", code, false);
+        if (t.run()) injector.key(code);
+    }
+
+    Q_INVOKABLE void text(const QString& s)
+    {
+        Timer t(this, "text", s, false);
+        if (t.run()) injector.text(s);
+    }
+
+private:
+    // 计时，析构时记录一步；已取消时在脚本中抛出异常，让脚本尽快结束
+    class Timer
+    {
+    public:
+        // flush: 先执行攒下的按键和文字，不计入本步
+        Timer(ScriptApi *api, const char *name, const QString& arg = QString(), bool flush = true): api(api)
+        {
+            if (flush) api->flush();
+            step.name = name;
+            step.arg = arg;
+            clock.start();
+        }
+
+        ~Timer()
+        {
+            step.ms = clock.elapsed();
+            api->list.push_back(step);
+        }
+
+        bool run()
+        {
+            if (!api->token.cancelled()) return true;
+            step.ok = false;
+            api->engine->throwError("cancelled");
+            return false;
+        }
+
+        bool ok(bool v)
+        {
+            step.ok = v;
+            return v;
+        }
+
+    private:
+        ScriptApi *api;
+        Step step;
+        QElapsedTimer clock;
+    };
+
+    // 字符串按文本定位，对象可指定 text / cls / rc
+    static CtrlLocator ctrl(const QJSValue& v)
+    {
+        if (!v.isObject()) return CtrlLocator(v.toString());
+        return CtrlLocator(v.property("text").isUndefined() ? QString() : v.property("text").toString(),
+                           v.property("cls").isUndefined() ? QString() : v.property("cls").toString(),
+                           v.property("rc").isUndefined() ? QString() : v.property("rc").toString());
+    }
+
+    // 同一脚本中重复使用的模板只加载一次
+    const TemplateMatcher& matcher(const QString& file)
+    {
+        auto it = templates.find(file);
+        if (it == templates.end()) it = templates.insert(file, TemplateMatcher(QImage(file)));
+        return *it;
+    }
+
+    static QString describe(const CtrlLocator& l)
+    {
+        if (l.rc.size()) return "rc=" + l.rc;
+        return l.cls.size() ? l.cls + ':' + l.text : l.text;
+    }
+
+    QJSValue bounds(Timer& t, AdbDevice::CtrlBound b)
+    {
+        if (!t.ok(b)) return QJSValue::NullValue;
+        auto v = engine->newObject();
+        v.setProperty("left", b.left);
+        v.setProperty("top", b.top);
+        v.setProperty("right", b.right);
+        v.setProperty("bottom", b.bottom);
+        v.setProperty("x", b.center().x);
+        v.setProperty("y", b.center().y);
+        return v;
+    }
+
+    AdbDevice *dev;
+    InputInjector injector;     // 整个脚本共用，写触摸屏的连接只打开一次
+    QJSEngine *engine;
+    CancelToken token;
+    QString& out;
+    QVector<Step> list;
+    QHash<QString, TemplateMatcher> templates;
+};
+
+struct ScriptRunner
+{
+    // 在一台设备上执行脚本，输出各步骤耗时，最后按步骤类型汇总
+    static FanOut::Task task(const QString& source, const QString& fileName = "script.js")
+    {
+        return [=](AdbDevice *dev, const CancelToken& token, QString& out) {
+            QJSEngine engine;
+            engine.installExtensions(QJSEngine::ConsoleExtension);
+            ScriptApi api(dev, &engine, token, out);
+            // 对象在栈上，不能交给脚本引擎回收
+            QJSEngine::setObjectOwnership(&api, QJSEngine::CppOwnership);
+            engine.globalObject().setProperty("dev", engine.newQObject(&api));
+
+            auto r = engine.evaluate(source, fileName);
+            bool ok = api.flush() && !r.isError() && !token.cancelled();
+            if (r.isError())
+                out += QString("%1:%2: %3\n").arg(fileName).arg(r.property("lineNumber").toInt()).arg(r.toString());
+
+            for (auto& s : api.steps())
+                out += QString("  %1 ms  %2(%3)%4\n").arg(s.ms, 6).arg(s.name, s.arg, s.ok ? "" : " 失败");
+            out += profile(api.steps());
+            return ok;
+        };
+    }
+
+    // 各类步骤的次数与耗时，按总耗时降序，看出时间主要花在哪里
+    static QString profile(const QVector<ScriptApi::Step>& steps)
+    {
+        struct Sum { int count = 0; qint64 total = 0, max = 0; };
+        QMap<QString, Sum> sums;
+        qint64 all = 0;
+        for (auto& s : steps)
+        {
+            auto& m = sums[s.name];
+            ++m.count;
+            m.total += s.ms;
+            m.max = qMax(m.max, s.ms);
+            all += s.ms;
+        }
+
+        auto names = sums.keys();
+        std::sort(names.begin(), names.end(), [&](const QString& a, const QString& b) {
+            return sums[a].total > sums[b].total;
+        });
+
+        QString text;
+        for (auto& n : names)
+        {
+            auto& m = sums[n];
+            text += QString("  [%1] %2 次, 共 %3 ms (%4%), 平均 %5 ms, 最长 %6 ms\n")
+                .arg(n).arg(m.count).arg(m.total).arg(all ? m.total * 100 / all : 0)
+                .arg(m.total / m.count).arg(m.max);
+        }
+        return text;
+    }
+};
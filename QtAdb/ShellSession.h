@@ -0,0 +1,152 @@
+#pragma once
+
+#include <QMutex>
+#include <QUuid>
+#include <QList>
+
+#include "AdbClient.h"
+
+// 设备上常驻的shell会话(shell v2 raw模式)
+// 每条命令的输出后面追加一行带退出码的结束标记，多条命令可以一次写入、按顺序取回，
+// 省去每条命令重新建立transport和启动shell进程的开销
+// 注意: 会话中的命令共享工作目录和环境变量
+class ShellSession
+{
+public:
+    struct Result
+    {
+        QByteArray out;
+        int code = -1;      // 退出码，-1表示会话中断未能取得
+    };
+
+    ShellSession(const QString& serial): serial(serial)
+    {
+        token = "__QTADB_" + QUuid::createUuid().toRfc4122().toHex() + "__";
+        marker = "\n" + token + " ";
+    }
+
+    // 依次执行多条命令，所有命令一次发送
+    // 会话中断时返回的结果比命令少，最后一条为中断时的部分输出
+    QList<Result> exec(const QList<QByteArray>& cmds)
+    {
+        QMutexLocker lock(&mutex);
+
+        QList<Result> results;
+        if (cmds.isEmpty()) return results;
+
+        QByteArray script;
+        for (auto& cmd : cmds) script += frame(cmd);
+
+        // 复用的会话可能已经失效(设备重连、adbd重启、adb root)，
+        // 还没收到任何输出就断开时重新打开一次，整组命令重新发送
+        for (bool reused = sock.isOpen(); open(); reused = false)
+        {
+            bool ok = writeStdin(script);
+            for (int i = 0; ok && i < cmds.size(); ++i)
+            {
+                Result r;
+                ok = readResult(r);
+                if (ok || !reused || results.size() || r.out.size()) results.push_back(r);
+            }
+            if (ok) break;
+            sock.close();
+            if (!reused || results.size()) break;
+        }
+        return results;
+    }
+
+    void close()
+    {
+        QMutexLocker lock(&mutex);
+        sock.close();
+    }
+
+private:
+    bool open()
+    {
+        if (sock.isOpen()) return true;
+        buf.clear();
+        scanned = 0;
+        return AdbClient::open(sock, serial, "shell,v2,raw:");
+    }
+
+    // 命令的标准输入重定向到/dev/null，避免读取后续命令
+    QByteArray frame(const QByteArray& cmd) const
+    {
+        return "{ " + cmd + "\n} </dev/null; printf '\\n%s %d\\n' " + token + " $?\n";
+    }
+
+    // adbd的shell协议缓冲区较小，分包写入
+    bool writeStdin(const QByteArray& data)
+    {
+        const int chunk = 4000;
+        for (int pos = 0; pos < data.size(); pos += chunk)
+        {
+            int n = qMin(chunk, data.size() - pos);
+            char hdr[5];
+            hdr[0] = AdbClient::StdIn;
+            qToLittleEndian<quint32>(quint32(n), hdr + 1);
+            if (!sock.write(hdr, 5) || !sock.write(data.constData() + pos, n))
+                return false;
+        }
+        return true;
+    }
+
+    // 读取一个数据包，标准输出追加到buf
+    bool readPacket()
+    {
+        char hdr[5];
+        if (!sock.readFully(hdr, 5)) return false;
+        int len = int(qFromLittleEndian<quint32>(hdr + 1));
+
+        if (hdr[0] == AdbClient::StdOut)
+        {
+            int old = buf.size();
+            buf.resize(old + len);
+            return sock.readFully(buf.data() + old, len);
+        }
+
+        QByteArray skip(len, Qt::Uninitialized);
+        if (!sock.readFully(skip.data(), len)) return false;
+        return hdr[0] != AdbClient::Exit;   // shell退出，会话结束
+    }
+
+    bool readResult(Result& r)
+    {
+        for (;;)
+        {
+            int pos = buf.indexOf(marker, scanned);
+            if (pos >= 0)
+            {
+                int b = pos + marker.size();
+                int nl = buf.indexOf('\n', b);
+                if (nl >= 0)
+                {
+                    r.out = buf.left(pos);
+                    r.code = buf.mid(b, nl - b).toInt();
+                    buf.remove(0, nl + 1);
+                    scanned = 0;
+                    return true;
+                }
+                scanned = pos;
+            }
+            else scanned = qMax(0, buf.size() - marker.size());
+
+            if (!readPacket())
+            {
+                r.out = buf;
+                buf.clear();
+                scanned = 0;
+                return false;
+            }
+        }
+    }
+
+    QString serial;
+    QByteArray token;       // 结束标记，每个会话随机生成
+    QByteArray marker;
+    QByteArray buf;         // 尚未取走的标准输出
+    int scanned = 0;        // buf中已确认不含结束标记的长度
+    AdbSocket sock;
+    QMutex mutex;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <QImage>
+#include <QVector>
+#include <QtMath>
+#include <algorithm>
+
+#include "Screencap.h"
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEMPLATE_MATCHER_SSE2
+#endif
+
+// 图片定位控件，用于uiautomator拿不到控件的场景(游戏、WebView)
+// 只在Region限定的范围内搜索，灰度图上用归一化互相关(NCC)比较：
+// 先在缩小的金字塔顶层全范围搜索，再逐层放大只在候选位置附近细化；点积用SSE2计算
+class TemplateMatcher
+{
+public:
+    struct Match
+    {
+        AdbDevice::CtrlBound bound;     // 屏幕坐标
+        double score = 0;               // -1 ~ 1
+    };
+
+    TemplateMatcher() {}
+
+    // 模板为设备分辨率下截取的图片
+    TemplateMatcher(const QImage& templ)
+    {
+        QImage t = templ.convertToFormat(QImage::Format_Grayscale8);
+        levels.push_back(Level(t));
+        // 模板最小边缩到8像素左右为止，最多5层；20多像素的小图标也至少缩小一层，
+        // 否则要在原始分辨率下全范围搜索，整屏时计算量是缩小一层的16倍
+        while (levels.size() < 5 && t.width() >= 16 && t.height() >= 16)
+        {
+            t = half(t);
+            levels.push_back(Level(t));
+        }
+    }
+
+    bool isNull() const { return levels.isEmpty() || levels[0].img.isNull(); }
+
+    // 截屏并查找，找不到或得分低于threshold时bound为空
+    Match find(AdbDevice *dev, const Region& region = Region(), double threshold = 0.85) const
+    {
+        QByteArray data;
+        auto screen = Screencap::grab(dev, data);
+        return find(screen, region, threshold);
+    }
+
+    Match find(const QImage& screen, const Region& region = Region(), double threshold = 0.85) const
+    {
+        Match m;
+        if (isNull() || screen.isNull()) return m;
+
+        // 只转换搜索范围内的部分
+        QRect area(QPoint(int(region.x1 * screen.width()), int(region.y1 * screen.height())),
+                   QPoint(int(region.x2 * screen.width()) - 1, int(region.y2 * screen.height()) - 1));
+        area &= screen.rect();
+        if (area.width() < levels[0].img.width() || area.height() < levels[0].img.height()) return m;
+
+        QVector<QImage> pyr{ screen.copy(area).convertToFormat(QImage::Format_Grayscale8) };
+        while (pyr.size() < levels.size()) pyr.push_back(half(pyr.last()));
+
+        // 顶层全范围搜索，保留几个互不重叠的候选
+        int top = levels.size() - 1;
+        auto cands = best(pyr[top], levels[top], QRect(QPoint(0, 0), pyr[top].size()), 3, threshold - 0.25);
+
+        // 逐层细化: 坐标加倍，在±2像素内找最高分
+        for (int l = top - 1; l >= 0; --l)
+        {
+            QVector<Cand> next;
+            for (auto& c : cands)
+            {
+                QRect around(2 * c.x - 2, 2 * c.y - 2, 5, 5);
+                auto r = best(pyr[l], levels[l], around, 1, -1);
+                if (r.size()) next.push_back(r[0]);
+            }
+            cands = next;
+        }
+
+        for (auto& c : cands)
+        {
+            if (c.score < threshold || c.score <= m.score) continue;
+            m.score = c.score;
+            m.bound.left = area.x() + c.x;
+            m.bound.top = area.y() + c.y;
+            m.bound.right = m.bound.left + levels[0].img.width();
+            m.bound.bottom = m.bound.top + levels[0].img.height();
+        }
+        return m;
+    }
+
+private:
+    // 金字塔中的一层模板，预先算好均值和方差
+    struct Level
+    {
+        QImage img;
+        double mean = 0;
+        double norm = 0;    // sqrt(sum((t - mean)^2))
+
+        Level() {}
+        Level(const QImage& t): img(t)
+        {
+            qint64 s = 0, sq = 0;
+            for (int y = 0; y < t.height(); ++y)
+            {
+                auto p = t.constScanLine(y);
+                for (int x = 0; x < t.width(); ++x) s += p[x], sq += p[x] * p[x];
+            }
+            double n = double(t.width()) * t.height();
+            mean = s / n;
+            norm = qSqrt(qMax(0.0, sq - s * mean));
+        }
+    };
+
+    struct Cand
+    {
+        int x, y;
+        double score;
+    };
+
+    // 2x2平均缩小
+    static QImage half(const QImage& g)
+    {
+        QImage h(g.width() / 2, g.height() / 2, QImage::Format_Grayscale8);
+        for (int y = 0; y < h.height(); ++y)
+        {
+            auto a = g.constScanLine(2 * y), b = g.constScanLine(2 * y + 1);
+            auto o = h.scanLine(y);
+            for (int x = 0; x < h.width(); ++x)
+                o[x] = uchar((a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1] + 2) >> 2);
+        }
+        return h;
+    }
+
+    static quint32 dot(const uchar *a, const uchar *b, int n)
+    {
+        quint32 s = 0;
+        int i = 0;
+#ifdef TEMPLATE_MATCHER_SSE2
+        // 8位扩展成16位后用madd两两相乘相加，每行的和不会超出32位
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = zero;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero)));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero)));
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        s = quint32(_mm_cvtsi128_si32(acc));
+#endif
+        for (; i < n; ++i) s += a[i] * b[i];
+        return s;
+    }
+
+    // 在搜索范围内(模板左上角的位置)求得分，返回最高的max个，彼此至少相距半个模板
+    static QVector<Cand> best(const QImage& img, const Level& t, QRect range, int max, double minScore)
+    {
+        int tw = t.img.width(), th = t.img.height();
+        range &= QRect(0, 0, img.width() - tw + 1, img.height() - th + 1);
+        QVector<Cand> all;
+        if (range.isEmpty() || t.norm <= 0) return all;
+
+        // 积分图，窗口内的和与平方和O(1)取得；只覆盖搜索范围用到的部分
+        int ox = range.left(), oy = range.top();
+        int iw = range.width() + tw, ih = range.height() + th;
+        QVector<qint64> sum(iw * ih), sq(sum.size());
+        for (int y = 0; y < ih - 1; ++y)
+        {
+            auto p = img.constScanLine(oy + y) + ox;
+            qint64 rs = 0, rq = 0;
+            for (int x = 0; x < iw - 1; ++x)
+            {
+                rs += p[x], rq += p[x] * p[x];
+                sum[(y + 1) * iw + x + 1] = sum[y * iw + x + 1] + rs;
+                sq[(y + 1) * iw + x + 1] = sq[y * iw + x + 1] + rq;
+            }
+        }
+        auto box = [&](const QVector<qint64>& s, int x, int y) {
+            x -= ox, y -= oy;
+            return s[(y + th) * iw + x + tw] - s[y * iw + x + tw] - s[(y + th) * iw + x] + s[y * iw + x];
+        };
+
+        // sum((I - mI)(T - mT)) = sum(I*T) - mT*sum(I)
+        double n = double(tw) * th;
+        for (int y = range.top(); y <= range.bottom(); ++y)
+        {
+            for (int x = range.left(); x <= range.right(); ++x)
+            {
+                qint64 si = box(sum, x, y);
+                double var = box(sq, x, y) - double(si) * si / n;
+                if (var <= 1e-6) continue;
+
+                qint64 st = 0;
+                for (int r = 0; r < th; ++r)
+                    st += dot(img.constScanLine(y + r) + x, t.img.constScanLine(r), tw);
+                double score = (st - t.mean * si) / (qSqrt(var) * t.norm);
+                if (score >= minScore) all.push_back(Cand{ x, y, score });
+            }
+        }
+
+        std::sort(all.begin(), all.end(), [](const Cand& a, const Cand& b) { return a.score > b.score; });
+        QVector<Cand> out;
+        for (auto& c : all)
+        {
+            bool overlap = false;
+            for (auto& o : out)
+                if (qAbs(o.x - c.x) < tw / 2 && qAbs(o.y - c.y) < th / 2) overlap = true;
+            if (overlap) continue;
+            out.push_back(c);
+            if (out.size() >= max) break;
+        }
+        return out;
+    }
+
+    QVector<Level> levels;      // 0为原始大小
+};
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+
+#include "AdbDevice.h"
+
+// 界面层次快照
+// 节点按先序存放在一个数组中，子树是连续的一段；字符串属性驻留后只存id，
+// 文本、resource-id、class建有索引，一次dump可以解析任意多个定位条件
+class UiHierarchy
+{
+public:
+    enum Flag
+    {
+        Clickable = 1, LongClickable = 2, Checkable = 4, Checked = 8, Enabled = 16,
+        Focusable = 32, Focused = 64, Scrollable = 128, Selected = 256, Password = 512,
+    };
+
+    struct Node
+    {
+        int parent = -1;
+        int end = 0;            // 子树之后的第一个节点
+        int index = 0;          // 在兄弟节点中的序号
+        int text = 0, rid = 0, cls = 0, pkg = 0, desc = 0;
+        quint16 flags = 0;
+        AdbDevice::CtrlBound bounds;
+    };
+
+    // 从设备抓取
+    static UiHierarchy capture(AdbDevice *dev)
+    {
+        UiHierarchy h;
+        QVector<int> stack;
+        dev->dump_ui([&](const QXmlStreamAttributes& attr) {
+            Node n;
+            n.parent = stack.isEmpty() ? -1 : stack.last();
+            n.index = attr.value("index").toInt();
+            n.text = h.intern(attr.value("text"));
+            n.rid = h.intern(attr.value("resource-id"));
+            n.cls = h.intern(attr.value("class"));
+            n.pkg = h.intern(attr.value("package"));
+            n.desc = h.intern(attr.value("content-desc"));
+            n.bounds = AdbDevice::parse_bounds(attr.value("bounds"));
+            for (int i = 0; i < FlagCount; ++i)
+                if (attr.value(flagNames()[i]) == QLatin1String("true")) n.flags |= 1 << i;
+
+            stack.push_back(h.nodes.size());
+            h.byText[n.text].push_back(h.nodes.size());
+            h.byRid[n.rid].push_back(h.nodes.size());
+            h.byCls[n.cls].push_back(h.nodes.size());
+            h.nodes.push_back(n);
+            return false;
+        }, [&] {
+            if (stack.isEmpty()) return;
+            h.nodes[stack.last()].end = h.nodes.size();
+            stack.pop_back();
+        });
+        // 不完整的输出
+        while (stack.size()) h.nodes[stack.takeLast()].end = h.nodes.size();
+        return h;
+    }
+
+    static QFuture<UiHierarchy> captureAsync(AdbDevice *dev)
+    {
+        return Async::run([dev] { return capture(dev); });
+    }
+
+    int size() const { return nodes.size(); }
+    bool isEmpty() const { return nodes.isEmpty(); }
+    const Node& node(int i) const { return nodes[i]; }
+
+    QString text(int i) const { return strs[nodes[i].text]; }
+    QString resourceId(int i) const { return strs[nodes[i].rid]; }
+    QString className(int i) const { return strs[nodes[i].cls]; }
+
+    // 属性值，名称与dump中的相同
+    QString attr(int i, const QString& name) const
+    {
+        auto& n = nodes[i];
+        if (name == "text") return strs[n.text];
+        if (name == "resource-id") return strs[n.rid];
+        if (name == "class") return strs[n.cls];
+        if (name == "package") return strs[n.pkg];
+        if (name == "content-desc") return strs[n.desc];
+        if (name == "index") return QString::number(n.index);
+        if (name == "bounds")
+            return QString("[%1,%2][%3,%4]").arg(n.bounds.left).arg(n.bounds.top).arg(n.bounds.right).arg(n.bounds.bottom);
+        int f = flagNames().indexOf(name);
+        if (f >= 0) return n.flags & (1 << f) ? "true" : "false";
+        return QString();
+    }
+
+    // 与find_ctrl相同的规则，返回第一个匹配的节点，没有时为-1
+    int find(const CtrlLocator& l) const
+    {
+        if (l.rc.size()) return byRid.value(lookup(l.rc)).value(0, -1);
+        int cls = l.cls.size() ? lookup(l.cls) : -1;
+        for (int i : byText.value(lookup(l.text)))
+            if (cls < 0 || nodes[i].cls == cls) return i;
+        return -1;
+    }
+
+    // 一次解析多个定位条件
+    QVector<AdbDevice::CtrlBound> findAll(const QList<CtrlLocator>& list) const
+    {
+        QVector<AdbDevice::CtrlBound> out;
+        for (auto& l : list)
+        {
+            int i = find(l);
+            out.push_back(i >= 0 ? nodes[i].bounds : AdbDevice::CtrlBound());
+        }
+        return out;
+    }
+
+    // 类XPath查询，返回按文档顺序的节点
+    //  /  子节点    //  后代节点    ..  父节点    *  任意节点
+    //  节点名为完整类名或最后一段，如 android.widget.Button 或 Button
+    //  条件: [@attr='v'] [@attr!='v'] [contains(@attr,'v')] [starts-with(@attr,'v')] [n](从1开始)
+    // 例: //ListView/*[2]//TextView[@resource-id='com.app:id/title']
+    QVector<int> query(const QString& path) const
+    {
+        QVector<int> ctx{ -1 };
+        int pos = 0;
+        while (pos < path.size() && ctx.size())
+        {
+            bool desc = false;
+            if (path.midRef(pos, 2) == QLatin1String("//")) desc = true, pos += 2;
+            else if (path[pos] == '/') ++pos;
+            else if (pos > 0) return QVector<int>();
+
+            Step st;
+            if (!parseStep(path, pos, st)) return QVector<int>();
+            ctx = apply(ctx, st, desc);
+        }
+        return ctx.size() == 1 && ctx[0] < 0 ? QVector<int>() : ctx;
+    }
+
+    int queryFirst(const QString& path) const
+    {
+        auto r = query(path);
+        return r.isEmpty() ? -1 : r[0];
+    }
+
+private:
+    enum { FlagCount = 10 };
+
+    static const QStringList& flagNames()
+    {
+        static const QStringList names = {
+            "clickable", "long-clickable", "checkable", "checked", "enabled",
+            "focusable", "focused", "scrollable", "selected", "password",
+        };
+        return names;
+    }
+
+    struct Pred
+    {
+        enum { Eq, Ne, Contains, StartsWith, Position } op;
+        QString attr;
+        QString value;
+        int pos = 0;
+    };
+
+    struct Step
+    {
+        QString name;           // 空为任意节点
+        bool parent = false;    // ..
+        QVector<Pred> preds;
+    };
+
+    int intern(const QStringRef& s)
+    {
+        auto str = s.toString();
+        auto it = ids.constFind(str);
+        if (it != ids.cend()) return *it;
+        strs.push_back(str);
+        return *ids.insert(str, strs.size() - 1);
+    }
+
+    int lookup(const QString& s) const { return ids.value(s, -1); }
+
+    static bool parseStep(const QString& p, int& pos, Step& st)
+    {
+        if (p.midRef(pos, 2) == QLatin1String(".."))
+        {
+            st.parent = true;
+            pos += 2;
+            return true;
+        }
+
+        int b = pos;
+        while (pos < p.size() && p[pos] != '/' && p[pos] != '[') ++pos;
+        st.name = p.mid(b, pos - b).trimmed();
+        if (st.name == "*") st.name.clear();
+
+        while (pos < p.size() && p[pos] == '[')
+        {
+            int e = p.indexOf(']', pos);
+            if (e < 0) return false;
+            Pred pr;
+            if (!parsePred(p.mid(pos + 1, e - pos - 1).trimmed(), pr)) return false;
+            st.preds.push_back(pr);
+            pos = e + 1;
+        }
+        return true;
+    }
+
+    static bool parsePred(const QString& s, Pred& pr)
+    {
+        bool ok = false;
+        pr.pos = s.toInt(&ok);
+        if (ok)
+        {
+            pr.op = Pred::Position;
+            return pr.pos > 0;
+        }
+
+        static const QRegExp fn(R"((contains|starts-with)\(\s*@([\w-]+)\s*,\s*['"](.*)['"]\s*\))");
+        static const QRegExp cmp(R"(@([\w-]+)\s*(!?=)\s*['"](.*)['"])");
+        QRegExp f = fn, c = cmp;
+        if (f.exactMatch(s))
+        {
+            pr.op = f.cap(1) == "contains" ? Pred::Contains : Pred::StartsWith;
+            pr.attr = f.cap(2);
+            pr.value = f.cap(3);
+            return true;
+        }
+        if (c.exactMatch(s))
+        {
+            pr.op = c.cap(2) == "=" ? Pred::Eq : Pred::Ne;
+            pr.attr = c.cap(1);
+            pr.value = c.cap(3);
+            return true;
+        }
+        return false;
+    }
+
+    bool nameMatches(int i, const QString& name) const
+    {
+        if (name.isEmpty()) return true;
+        auto& cls = strs[nodes[i].cls];
+        return cls == name || (cls.endsWith(name) && cls.size() > name.size() && cls[cls.size() - name.size() - 1] == '.');
+    }
+
+    bool predMatches(int i, const Pred& pr) const
+    {
+        auto v = attr(i, pr.attr);
+        switch (pr.op)
+        {
+        case Pred::Eq: return v == pr.value;
+        case Pred::Ne: return v != pr.value;
+        case Pred::Contains: return v.contains(pr.value);
+        case Pred::StartsWith: return v.startsWith(pr.value);
+        default: return true;
+        }
+    }
+
+    // 对每个上下文节点求出候选，再按条件依次筛选；位置条件针对同一上下文节点的候选
+    QVector<int> apply(const QVector<int>& ctx, const Step& st, bool desc) const
+    {
+        QVector<bool> mark(nodes.size());
+        for (int c : ctx)
+        {
+            QVector<int> cand;
+            if (st.parent)
+            {
+                if (c >= 0 && nodes[c].parent >= 0) cand.push_back(nodes[c].parent);
+            }
+            else if (desc) cand = descendants(c, st);
+            else
+            {
+                int b = c < 0 ? 0 : c + 1, e = c < 0 ? nodes.size() : nodes[c].end;
+                for (int j = b; j < e; j = nodes[j].end) cand.push_back(j);
+            }
+
+            if (!st.parent)
+            {
+                QVector<int> named;
+                for (int j : cand)
+                    if (nameMatches(j, st.name)) named.push_back(j);
+                cand = named;
+            }
+            for (auto& pr : st.preds)
+            {
+                QVector<int> next;
+                if (pr.op == Pred::Position)
+                {
+                    if (pr.pos <= cand.size()) next.push_back(cand[pr.pos - 1]);
+                }
+                else for (int j : cand)
+                    if (predMatches(j, pr)) next.push_back(j);
+                cand = next;
+            }
+            for (int j : cand) mark[j] = true;
+        }
+
+        QVector<int> out;
+        for (int i = 0; i < mark.size(); ++i)
+            if (mark[i]) out.push_back(i);
+        return out;
+    }
+
+    // 后代节点；首个条件是文本、resource-id、class相等时先从索引取候选
+    QVector<int> descendants(int c, const Step& st) const
+    {
+        int b = c < 0 ? 0 : c + 1, e = c < 0 ? nodes.size() : nodes[c].end;
+        if (st.preds.size() && st.preds[0].op == Pred::Eq)
+        {
+            auto& pr = st.preds[0];
+            const QHash<int, QVector<int>> *idx = pr.attr == "text" ? &byText
+                : pr.attr == "resource-id" ? &byRid : pr.attr == "class" ? &byCls : nullptr;
+            if (idx)
+            {
+                QVector<int> out;
+                for (int j : idx->value(lookup(pr.value)))
+                    if (j >= b && j < e) out.push_back(j);
+                return out;
+            }
+        }
+
+        QVector<int> out;
+        for (int j = b; j < e; ++j) out.push_back(j);
+        return out;
+    }
+
+    QVector<Node> nodes;
+    QVector<QString> strs;
+    QHash<QString, int> ids;
+    QHash<int, QVector<int>> byText, byRid, byCls;     // 字符串id -> 节点(文档顺序)
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <QtTest>
+
+#include "AdbDevice.h"
+
+// 解析shell输出: 逐行QString + LineParser 与 ByteView + LineView 的对比
+// 两种方式先校验结果一致，再各自计时
+class BenchParse : public QObject
+{
+    Q_OBJECT
+
+    ShellResult ps;     // ps -A -o NAME,PID,PPID,USER,VSZ,CMDLINE
+    ShellResult maps;   // /proc/<pid>/maps
+
+    // 汇总解析出的字段，防止被优化掉，也用于比较两种方式的结果
+    struct Sum
+    {
+        qint64 ids = 0;
+        qint64 chars = 0;
+        int rows = 0;
+
+        bool operator==(const Sum& o) const { return ids == o.ids && chars == o.chars && rows == o.rows; }
+    };
+
+    static ShellResult makePs(int n)
+    {
+        QByteArray out;
+        for (int i = 0; i < n; ++i)
+        {
+            if (i % 5 == 4)
+                out += QString("[kworker/%1:1H] %2 2 root 0\n").arg(i % 8).arg(i + 100).toUtf8();
+            else
+                out += QString("com.example.app%1 %2 %3 u0_a%4 %5 com.example.app%1:service --flag %6\r\n")
+                    .arg(i).arg(i + 100).arg(i / 10 + 1).arg(i % 300).arg(1000000 + i * 4096).arg(i).toUtf8();
+        }
+        return ShellResult(std::move(out));
+    }
+
+    static ShellResult makeMaps(int n)
+    {
+        QByteArray out;
+        for (int i = 0; i < n; ++i)
+        {
+            quint64 b = 0x7f00000000ull + quint64(i) * 0x2000;
+            out += QString("%1-%2 r-xp %3 fd:01 %4                            /system/lib64/libfoo%5.so\n")
+                .arg(b, 0, 16).arg(b + 0x1000, 0, 16).arg(i * 0x1000, 8, 16, QChar('0'))
+                .arg(1000 + i).arg(i % 50).toUtf8();
+        }
+        return ShellResult(std::move(out));
+    }
+
+    static Sum psQString(const ShellResult& r)
+    {
+        Sum s;
+        for (auto line : r)
+        {
+            LineParser p(std::move(line));
+            auto name = p.psname();
+            if (name.isEmpty() || name.startsWith('[')) continue;
+            s.ids += p.next().toInt() + p.next().toInt();
+            s.chars += p.next().size() + p.next().size() + p.rest().size() + name.size();
+            ++s.rows;
+        }
+        return s;
+    }
+
+    static Sum psByteView(const ShellResult& r)
+    {
+        Sum s;
+        for (auto line : r.lineViews())
+        {
+            LineView p(line);
+            auto name = p.psname();
+            if (name.isEmpty() || name.startsWith('[')) continue;
+            s.ids += p.next().toInt() + p.next().toInt();
+            s.chars += p.next().size() + p.next().size() + p.rest().size() + name.size();
+            ++s.rows;
+        }
+        return s;
+    }
+
+    static Sum mapsQString(const ShellResult& r)
+    {
+        Sum s;
+        for (auto line : r)
+        {
+            LineParser p(std::move(line));
+            auto range = p.next();
+            int dash = range.indexOf('-');
+            s.ids += range.left(dash).toULongLong(nullptr, 16) >> 12;
+            s.ids += range.mid(dash + 1).toULongLong(nullptr, 16) >> 12;
+            s.chars += p.next().size();
+            s.ids += p.next().toLongLong(nullptr, 16);
+            p.next();
+            s.ids += p.next().toInt();
+            s.chars += p.rest().size();
+            ++s.rows;
+        }
+        return s;
+    }
+
+    static Sum mapsByteView(const ShellResult& r)
+    {
+        Sum s;
+        for (auto line : r.lineViews())
+        {
+            LineView p(line);
+            auto range = p.next();
+            int dash = range.indexOf('-');
+            s.ids += range.mid(0, dash).toULongLong(nullptr, 16) >> 12;
+            s.ids += range.mid(dash + 1).toULongLong(nullptr, 16) >> 12;
+            s.chars += p.next().size();
+            s.ids += p.next().toLongLong(nullptr, 16);
+            p.next();
+            s.ids += p.next().toInt();
+            s.chars += p.rest().size();
+            ++s.rows;
+        }
+        return s;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        ps = makePs(20000);
+        maps = makeMaps(20000);
+    }
+
+    void sameResult()
+    {
+        QVERIFY(psQString(ps) == psByteView(ps));
+        QCOMPARE(psByteView(ps).rows, 16000);
+        QVERIFY(mapsQString(maps) == mapsByteView(maps));
+        QCOMPARE(mapsByteView(maps).rows, 20000);
+    }
+
+    void psLineParser()
+    {
+        Sum s;
+        QBENCHMARK { s = psQString(ps); }
+        QVERIFY(s.rows > 0);
+    }
+
+    void psLineView()
+    {
+        Sum s;
+        QBENCHMARK { s = psByteView(ps); }
+        QVERIFY(s.rows > 0);
+    }
+
+    void mapsLineParser()
+    {
+        Sum s;
+        QBENCHMARK { s = mapsQString(maps); }
+        QVERIFY(s.rows > 0);
+    }
+
+    void mapsLineView()
+    {
+        Sum s;
+        QBENCHMARK { s = mapsByteView(maps); }
+        QVERIFY(s.rows > 0);
+    }
+};
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+#include <functional>
+#include <thread>
+
+#include "AdbClient.h"
+
+#ifndef _WIN32
+#include <sys/select.h>
+#endif
+
+// 测试用的adb server，监听本机随机端口，每个连接在独立线程中交给handler处理
+// 进程内只有一个实例，创建时设置 ANDROID_ADB_SERVER_PORT，须在 AdbClient::port() 首次调用之前
+class FakeAdbServer
+{
+public:
+    // 服务端一侧的连接，handler返回后关闭
+    class Conn
+    {
+    public:
+        explicit Conn(AdbSocket::Handle fd): fd(fd) {}
+        Conn(const Conn&) = delete;
+        Conn& operator=(const Conn&) = delete;
+        ~Conn() { close(); }
+
+        void close()
+        {
+            if (fd == AdbSocket::invalid()) return;
+#ifdef _WIN32
+            ::closesocket(fd);
+#else
+            ::close(fd);
+#endif
+            fd = AdbSocket::invalid();
+        }
+
+        bool readFully(char *p, int n)
+        {
+            while (n > 0)
+            {
+                int r = int(::recv(fd, p, n, 0));
+                if (r <= 0) return false;
+                p += r, n -= r;
+            }
+            return true;
+        }
+
+        // ms毫秒内是否有数据可读
+        bool waitReadable(int ms)
+        {
+            fd_set set;
+            FD_ZERO(&set);
+            FD_SET(fd, &set);
+            timeval t = { ms / 1000, (ms % 1000) * 1000 };
+            return ::select(int(fd + 1), &set, nullptr, nullptr, &t) > 0;
+        }
+
+        // 读取n字节，连接断开时返回空
+        QByteArray read(int n)
+        {
+            QByteArray data(n, Qt::Uninitialized);
+            return readFully(data.data(), n) ? data : QByteArray();
+        }
+
+        bool write(const QByteArray& data)
+        {
+#ifdef MSG_NOSIGNAL
+            const int flags = MSG_NOSIGNAL;
+#else
+            const int flags = 0;
+#endif
+            const char *p = data.constData();
+            for (int n = data.size(); n > 0; )
+            {
+                int r = int(::send(fd, p, n, flags));
+                if (r <= 0) return false;
+                p += r, n -= r;
+            }
+            return true;
+        }
+
+        // 分成若干小段写出，检验客户端对拆包的处理
+        bool writeSplit(const QByteArray& data, int piece)
+        {
+            for (int i = 0; i < data.size(); i += piece)
+            {
+                if (!write(data.mid(i, piece))) return false;
+                std::this_thread::yield();
+            }
+            return true;
+        }
+
+        // 智能套接字请求: 4位十六进制长度 + 服务名
+        QByteArray request()
+        {
+            bool ok = false;
+            int n = read(4).toInt(&ok, 16);
+            return ok ? read(n) : QByteArray();
+        }
+
+        void okay() { write("OKAY"); }
+        void fail(const QByteArray& msg) { write("FAIL" + hex4(msg.size()) + msg); }
+        void block(const QByteArray& data) { write(hex4(data.size()) + data); }
+
+        // 应答 host:transport 并取回之后的服务名
+        QByteArray transport(QByteArray *serial = nullptr)
+        {
+            auto t = request();
+            if (serial) *serial = t;
+            okay();
+            return request();
+        }
+
+        // shell v2 数据包: 1字节id + 4字节小端长度 + 数据
+        static QByteArray shellPacket(int id, const QByteArray& data)
+        {
+            return char(id) + le32(quint32(data.size())) + data;
+        }
+
+        // sync 数据包: 4字节id + 4字节小端长度或数值 + 数据
+        static QByteArray syncPacket(const char *id, quint32 len, const QByteArray& data = QByteArray())
+        {
+            return QByteArray(id, 4) + le32(len) + data;
+        }
+
+        static QByteArray syncPacket(const char *id, const QByteArray& data)
+        {
+            return syncPacket(id, quint32(data.size()), data);
+        }
+
+        // 读取一个sync请求，DONE的4字节为修改时间，没有数据
+        bool readSync(QByteArray& id, QByteArray& data)
+        {
+            char hdr[8];
+            if (!readFully(hdr, 8)) return false;
+            id = QByteArray(hdr, 4);
+            int len = int(qFromLittleEndian<quint32>(hdr + 4));
+            data = id == "DONE" ? QByteArray() : read(len);
+            return data.size() == (id == "DONE" ? 0 : len);
+        }
+
+        static QByteArray le32(quint32 v)
+        {
+            char b[4];
+            qToLittleEndian<quint32>(v, b);
+            return QByteArray(b, 4);
+        }
+
+    private:
+        static QByteArray hex4(int n) { return QByteArray::number(n, 16).rightJustified(4, '0'); }
+
+        AdbSocket::Handle fd;
+    };
+
+    typedef std::function<void(Conn&)> Handler;
+
+    static FakeAdbServer& instance()
+    {
+        // 不析构，连接线程分离后随进程退出
+        static FakeAdbServer *s = new FakeAdbServer;
+        return *s;
+    }
+
+    quint16 port() const { return listenPort; }
+
+    // 之后的连接交给handler处理
+    void setHandler(const Handler& h)
+    {
+        QMutexLocker lock(&mutex);
+        handler = h;
+    }
+
+    // 等待所有连接处理完毕
+    void waitIdle()
+    {
+        QMutexLocker lock(&mutex);
+        while (active > 0) idle.wait(&mutex);
+    }
+
+    // 已接受的连接数
+    int connections()
+    {
+        QMutexLocker lock(&mutex);
+        return accepted;
+    }
+
+private:
+    FakeAdbServer()
+    {
+#ifdef _WIN32
+        WSADATA d;
+        WSAStartup(MAKEWORD(2, 2), &d);
+#endif
+        fd = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = 0;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        ::bind(fd, (sockaddr*)&addr, sizeof(addr));
+        ::listen(fd, 16);
+
+        socklen_t len = sizeof(addr);
+        ::getsockname(fd, (sockaddr*)&addr, &len);
+        listenPort = ntohs(addr.sin_port);
+        qputenv("ANDROID_ADB_SERVER_PORT", QByteArray::number(listenPort));
+
+        std::thread([this] { loop(); }).detach();
+    }
+
+    void loop()
+    {
+        for (;;)
+        {
+            auto c = ::accept(fd, nullptr, nullptr);
+            if (c == AdbSocket::invalid()) return;
+
+            Handler h;
+            {
+                QMutexLocker lock(&mutex);
+                h = handler;
+                ++active, ++accepted;
+            }
+            std::thread([this, h, c] {
+                {
+                    Conn conn(c);
+                    if (h) h(conn);
+                }
+                QMutexLocker lock(&mutex);
+                if (--active == 0) idle.wakeAll();
+            }).detach();
+        }
+    }
+
+    AdbSocket::Handle fd = AdbSocket::invalid();
+    quint16 listenPort = 0;
+
+    QMutex mutex;
+    QWaitCondition idle;
+    Handler handler;
+    int active = 0;
+    int accepted = 0;
+};
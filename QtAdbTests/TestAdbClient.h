@@ -0,0 +1,213 @@
+#pragma once
+
+#include <QtTest>
+
+#include "AdbClient.h"
+#include "ShellSession.h"
+#include "FakeAdbServer.h"
+
+// AdbClient 的协议细节: 请求的长度前缀、OKAY/FAIL应答、host:transport 切换、shell v2 分包
+class TestAdbClient : public QObject
+{
+    Q_OBJECT
+
+    typedef FakeAdbServer::Conn Conn;
+
+    FakeAdbServer& server = FakeAdbServer::instance();
+    QMutex mutex;
+    QByteArrayList received;    // 服务端收到的请求，按顺序
+
+    void record(const QByteArray& r)
+    {
+        QMutexLocker lock(&mutex);
+        received.push_back(r);
+    }
+
+private Q_SLOTS:
+    void init() { received.clear(); }
+
+    void cleanup()
+    {
+        server.waitIdle();
+        server.setHandler(nullptr);
+    }
+
+    void lengthPrefix()
+    {
+        server.setHandler([this](Conn& c) {
+            record(c.read(16));
+            c.okay();
+            c.block("0029");
+        });
+        QString err;
+        QCOMPARE(AdbClient::query("host:version", &err), QByteArray("0029"));
+        server.waitIdle();
+        QCOMPARE(received, QByteArrayList{ "000chost:version" });
+    }
+
+    // 长度为小写十六进制，超过255字节时也是4位
+    void longRequest()
+    {
+        QByteArray service = "shell:" + QByteArray(294, 'x');
+        server.setHandler([this](Conn& c) {
+            record(c.read(4));
+            record(c.read(300));
+            c.okay();
+            c.block(QByteArray());
+        });
+        QCOMPARE(AdbClient::query(service), QByteArray());
+        server.waitIdle();
+        QCOMPARE(received, (QByteArrayList{ "012c", service }));
+    }
+
+    void failResponse()
+    {
+        server.setHandler([this](Conn& c) {
+            record(c.request());
+            c.fail("device 'emulator-5556' not found");
+        });
+        AdbSocket s;
+        QString err;
+        QVERIFY(!AdbClient::open(s, "emulator-5556", "shell:ls", &err));
+        QCOMPARE(err, QString("device 'emulator-5556' not found"));
+        server.waitIdle();
+        // 切换设备失败后不再发送服务请求
+        QCOMPARE(received, QByteArrayList{ "host:transport:emulator-5556" });
+    }
+
+    void badResponse()
+    {
+        server.setHandler([](Conn& c) {
+            c.request();
+            c.write("WHAT");
+        });
+        QString err;
+        QVERIFY(AdbClient::query("host:devices", &err).isEmpty());
+        QVERIFY(err.startsWith("bad response"));
+    }
+
+    // 查询失败与特性列表为空要能区分，失败的结果不能被缓存
+    void features()
+    {
+        server.setHandler([this](Conn& c) {
+            record(c.request());
+            c.okay();
+            c.block("shell_v2,cmd,stat_v2,ls_v2");
+        });
+        QString err;
+        QCOMPARE(AdbClient::features("emulator-5554", &err), (QStringList{ "shell_v2", "cmd", "stat_v2", "ls_v2" }));
+        QVERIFY(err.isEmpty());
+        server.waitIdle();
+        QCOMPARE(received, QByteArrayList{ "host-serial:emulator-5554:features" });
+
+        server.setHandler([](Conn& c) {
+            c.request();
+            c.fail("device offline");
+        });
+        QVERIFY(AdbClient::features("emulator-5554", &err).isEmpty());
+        QCOMPARE(err, QString("device offline"));
+    }
+
+    void transport()
+    {
+        server.setHandler([this](Conn& c) {
+            QByteArray serial;
+            auto service = c.transport(&serial);
+            record(serial);
+            record(service);
+            c.okay();
+        });
+        AdbSocket s;
+        QVERIFY(AdbClient::open(s, "emulator-5554", "sync:"));
+        s.close();
+        QVERIFY(AdbClient::open(s, QString(), "logcat:"));
+        s.close();
+        server.waitIdle();
+        QCOMPARE(received, (QByteArrayList{ "host:transport:emulator-5554", "sync:",
+                                            "host:transport-any", "logcat:" }));
+    }
+
+    // 包头和数据拆成小段到达，标准输出与标准错误交错
+    void shellV2Framing()
+    {
+        server.setHandler([this](Conn& c) {
+            record(c.transport());
+            c.okay();
+            auto stream = Conn::shellPacket(AdbClient::StdOut, "hello ")
+                        + Conn::shellPacket(AdbClient::StdErr, "warn\n")
+                        + Conn::shellPacket(AdbClient::StdOut, QByteArray())
+                        + Conn::shellPacket(AdbClient::StdOut, "world")
+                        + Conn::shellPacket(AdbClient::Exit, QByteArray(1, char(3)));
+            c.writeSplit(stream, 3);
+        });
+        int code = -1;
+        QByteArray errOut;
+        QCOMPARE(AdbClient::shell("emulator-5554", "echo hi", true, &code, &errOut), QByteArray("hello world"));
+        QCOMPARE(errOut, QByteArray("warn\n"));
+        QCOMPARE(code, 3);
+        server.waitIdle();
+        QCOMPARE(received, QByteArrayList{ "shell,v2,raw:echo hi" });
+    }
+
+    // 退出码到达之前连接断开，保留已收到的输出，退出码不变
+    void shellV2Truncated()
+    {
+        server.setHandler([](Conn& c) {
+            c.transport();
+            c.okay();
+            c.write(Conn::shellPacket(AdbClient::StdOut, "partial") + Conn::shellPacket(AdbClient::StdOut, "lost").left(7));
+        });
+        int code = -1;
+        bool ok = true;
+        QCOMPARE(AdbClient::shell("emulator-5554", "cat", true, &code, nullptr, &ok), QByteArray("partial"));
+        QCOMPARE(code, -1);
+        QVERIFY(!ok);
+    }
+
+    // 常驻会话的连接被对端关闭后(如adbd重启)，下一次执行重新打开会话，第一条命令不能丢
+    void sessionReopen()
+    {
+        server.setHandler([](Conn& c) {
+            c.transport();
+            c.okay();
+            // 每个连接只应答一批命令就断开
+            auto hdr = c.read(5);
+            if (hdr.size() < 5) return;
+            auto script = QString::fromUtf8(c.read(int(qFromLittleEndian<quint32>(hdr.constData() + 1))));
+            static const QRegularExpression re("printf '\\\\n%s %d\\\\n' (\\S+) \\$\\?");
+            QByteArray out;
+            for (auto it = re.globalMatch(script); it.hasNext(); )
+                out += "ok\n" + it.next().captured(1).toUtf8() + " 0\n";
+            c.write(Conn::shellPacket(AdbClient::StdOut, out));
+        });
+        ShellSession session("emulator-5554");
+        QCOMPARE(session.exec({ "true" }).size(), 1);
+        server.waitIdle();
+        int before = server.connections();
+
+        auto r = session.exec({ "echo a", "echo b" });
+        QCOMPARE(r.size(), 2);
+        for (auto& x : r)
+        {
+            QCOMPARE(x.out, QByteArray("ok"));
+            QCOMPARE(x.code, 0);
+        }
+        server.waitIdle();
+        QCOMPARE(server.connections(), before + 1);
+    }
+
+    // v1没有分包，读到连接关闭为止
+    void shellV1()
+    {
+        server.setHandler([this](Conn& c) {
+            record(c.transport());
+            c.okay();
+            c.writeSplit(QByteArray(100000, 'a'), 4096);
+        });
+        bool ok = false;
+        QCOMPARE(AdbClient::shell("emulator-5554", "cat big", false, nullptr, nullptr, &ok), QByteArray(100000, 'a'));
+        QVERIFY(ok);
+        server.waitIdle();
+        QCOMPARE(received, QByteArrayList{ "shell:cat big" });
+    }
+};
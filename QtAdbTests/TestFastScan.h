@@ -0,0 +1,194 @@
+#pragma once
+
+#include <QtTest>
+#include <QRandomGenerator>
+#include <vector>
+#include <climits>
+
+#include "FastScan.h"
+
+// FastScan 的向量化路径与逐字节实现的一致性，以及10MB输出上的耗时对比
+// 随机数据偏向空白和控制字符，让字段边界频繁落在16/32字节块的交界处
+class TestFastScan : public QObject
+{
+    Q_OBJECT
+
+    typedef std::vector<std::pair<int, int>> Fields;
+
+    // ---- 逐字节的参考实现 ----
+
+    static std::vector<int> refNewlines(const char *p, int n)
+    {
+        std::vector<int> v;
+        for (int i = 0; i < n; ++i)
+            if (p[i] == '\n') v.push_back(i);
+        return v;
+    }
+
+    static int refSkipSpace(const char *p, int i, int n)
+    {
+        while (i < n && FastScan::isSpace(p[i])) ++i;
+        return i;
+    }
+
+    static int refFindSpace(const char *p, int i, int n)
+    {
+        while (i < n && !FastScan::isSpace(p[i])) ++i;
+        return i;
+    }
+
+    // 最多取max个字段，模拟f返回false时提前停止
+    static Fields refFields(const char *p, int n, int max = INT_MAX)
+    {
+        Fields v;
+        for (int i = 0; i < n && int(v.size()) < max; )
+        {
+            i = refSkipSpace(p, i, n);
+            if (i == n) break;
+            int e = refFindSpace(p, i, n);
+            v.push_back({ i, e });
+            i = e;
+        }
+        return v;
+    }
+
+    // ---- 被测实现 ----
+
+    static std::vector<int> newlines(const char *p, int n)
+    {
+        std::vector<int> v;
+        FastScan::forEachNewline(p, n, [&](int i) { v.push_back(i); });
+        return v;
+    }
+
+    static Fields fields(const char *p, int n, int max = INT_MAX)
+    {
+        Fields v;
+        FastScan::forEachField(p, n, [&](int b, int e) {
+            v.push_back({ b, e });
+            return int(v.size()) < max;
+        });
+        return v;
+    }
+
+    // 每个字节取自空白、控制字符、高位字节和普通字符
+    static QByteArray randomBytes(QRandomGenerator& rng, int n)
+    {
+        static const char pool[] = " \t\n\v\f\r" "\x08\x0e\x1f\x7f\x80\x89\x8d\xa0\xff" "aZ0-/[";
+        QByteArray b(n, Qt::Uninitialized);
+        // 每段数据的空白比例不同，既有长字段也有连续的空白
+        int spaceBias = rng.bounded(100);
+        for (int i = 0; i < n; ++i)
+            b[i] = int(rng.bounded(100)) < spaceBias ? pool[rng.bounded(6)] : pool[6 + rng.bounded(int(sizeof(pool)) - 7)];
+        return b;
+    }
+
+    // 检查所有接口在缓冲区p[0, n)上的结果
+    static bool check(const char *p, int n)
+    {
+        if (newlines(p, n) != refNewlines(p, n)) return false;
+        if (fields(p, n) != refFields(p, n)) return false;
+        for (int max = 1; max <= 3; ++max)
+            if (fields(p, n, max) != refFields(p, n, max)) return false;
+        for (int i = 0; i <= n; ++i)
+        {
+            if (FastScan::skipSpace(p, i, n) != refSkipSpace(p, i, n)) return false;
+            if (FastScan::findSpace(p, i, n) != refFindSpace(p, i, n)) return false;
+        }
+        return true;
+    }
+
+    // 10MB的类ps输出
+    static QByteArray bigOutput()
+    {
+        QByteArray line = "u0_a123       12345   678 1234567  45678 SyS_epoll_wait      0 S com.example.app:remote\n";
+        QByteArray out;
+        out.reserve(10 * 1024 * 1024 + line.size());
+        while (out.size() < 10 * 1024 * 1024) out += line;
+        return out;
+    }
+
+private Q_SLOTS:
+    void randomEquivalence()
+    {
+        QRandomGenerator rng(20240601);
+        for (int round = 0; round < 20000; ++round)
+        {
+            // 前面留出0~31字节，使起始地址和块边界错开
+            int pad = rng.bounded(32);
+            auto buf = randomBytes(rng, pad + rng.bounded(160));
+            if (!check(buf.constData() + pad, buf.size() - pad))
+                QFAIL(qPrintable(QString("mismatch, round %1: %2").arg(round).arg(QString(buf.mid(pad).toHex()))));
+        }
+    }
+
+    // 单段空白或单个字段落在48字节中的每一种位置，覆盖跨块的carry
+    void blockBoundaries()
+    {
+        for (int n = 1; n <= 48; ++n)
+            for (int b = 0; b < n; ++b)
+                for (int e = b + 1; e <= n; ++e)
+                {
+                    QByteArray word(n, 'x'), gap(n, ' ');
+                    word.replace(b, e - b, QByteArray(e - b, ' '));
+                    gap.replace(b, e - b, QByteArray(e - b, 'x'));
+                    QVERIFY2(check(word.constData(), n), word.constData());
+                    QVERIFY2(check(gap.constData(), n), gap.constData());
+                }
+    }
+
+    // 换行恰好位于各块的首尾
+    void newlineBoundaries()
+    {
+        QByteArray b(96, 'a');
+        for (int i : { 0, 15, 16, 31, 32, 63, 64, 95 }) b[i] = '\n';
+        QCOMPARE(newlines(b.constData(), b.size()), refNewlines(b.constData(), b.size()));
+        QCOMPARE(newlines(b.constData(), b.size()).size(), size_t(8));
+    }
+
+    void benchNewlineScalar()
+    {
+        auto out = bigOutput();
+        int count = 0;
+        QBENCHMARK {
+            count = 0;
+            for (int i = 0; i < out.size(); ++i)
+                if (out.constData()[i] == '\n') ++count;
+        }
+        QVERIFY(count > 0);
+    }
+
+    void benchNewlineSimd()
+    {
+        auto out = bigOutput();
+        int count = 0;
+        QBENCHMARK {
+            count = 0;
+            FastScan::forEachNewline(out.constData(), out.size(), [&](int) { ++count; });
+        }
+        QCOMPARE(size_t(count), refNewlines(out.constData(), out.size()).size());
+    }
+
+    void benchFieldsScalar()
+    {
+        auto out = bigOutput();
+        int count = 0;
+        QBENCHMARK {
+            count = 0;
+            for (int i = 0, n = out.size(); (i = refSkipSpace(out.constData(), i, n)) < n; ++count)
+                i = refFindSpace(out.constData(), i, n);
+        }
+        QVERIFY(count > 0);
+    }
+
+    void benchFieldsSimd()
+    {
+        auto out = bigOutput();
+        int count = 0;
+        QBENCHMARK {
+            count = 0;
+            FastScan::forEachField(out.constData(), out.size(), [&](int, int) { ++count; return true; });
+        }
+        QCOMPARE(size_t(count), refFields(out.constData(), out.size()).size());
+    }
+};
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QRegularExpression>
+
+#include "FileTransfer.h"
+#include "FakeAdbServer.h"
+
+// 内存中的设备文件系统，按sync协议v1应答 LIST/STAT/SEND/RECV，exec服务只支持 tail -c +N
+// 上传的应答在没有后续请求时才发出，客户端不等应答连续上传时，积压的应答数会大于1
+struct FakeSyncDevice
+{
+    typedef FakeAdbServer::Conn Conn;
+
+    QMutex mutex;
+    QMap<QString, QByteArray> files;    // 路径 -> 内容，目录由路径推出
+    QSet<QString> failing;              // 上传这些路径时应答FAIL
+    QByteArrayList execs;               // exec服务收到的命令
+    int truncateExec = -1;              // exec只输出这么多字节就断开
+    int maxPending = 0;                 // 同一连接上最多积压的上传应答
+    int syncConnections = 0;
+
+    void serve(Conn& c)
+    {
+        auto service = c.request();
+        if (service.endsWith(":features"))
+        {
+            c.okay();
+            c.block(QByteArray());
+            return;
+        }
+        c.okay();
+        service = c.request();
+        c.okay();
+        if (service == "sync:") sync(c);
+        else if (service.startsWith("exec:")) exec(c, service.mid(5));
+    }
+
+    bool isDir(const QString& path)
+    {
+        QMutexLocker lock(&mutex);
+        auto prefix = path.endsWith('/') ? path : path + '/';
+        auto it = files.lowerBound(prefix);
+        return it != files.end() && it.key().startsWith(prefix);
+    }
+
+    // 文件: mode size mtime，不存在时全为0
+    QByteArray stat(const QString& path)
+    {
+        quint32 mode = 0, size = 0;
+        {
+            QMutexLocker lock(&mutex);
+            auto it = files.constFind(path);
+            if (it != files.cend()) mode = 0100644, size = quint32(it->size());
+        }
+        if (!mode && isDir(path)) mode = 040755;
+        return Conn::le32(mode) + Conn::le32(size) + Conn::le32(1500000000);
+    }
+
+    void sync(Conn& c)
+    {
+        struct Pending { QString path; QByteArray data; };
+        QList<Pending> pending;
+        bool failed = false;
+        {
+            QMutexLocker lock(&mutex);
+            ++syncConnections;
+        }
+
+        // 按顺序发出积压的应答，FAIL之后与adbd一样丢弃后续数据直到客户端断开
+        auto flush = [&] {
+            for (auto& p : pending)
+            {
+                QMutexLocker lock(&mutex);
+                if (failing.contains(p.path))
+                {
+                    c.write(Conn::syncPacket("FAIL", "permission denied"));
+                    failed = true;
+                    break;
+                }
+                files[p.path] = p.data;
+                c.write(Conn::syncPacket("OKAY", 0));
+            }
+            pending.clear();
+        };
+
+        QByteArray id, data;
+        for (;;)
+        {
+            if (pending.size() && !c.waitReadable(50)) flush();
+            if (!c.readSync(id, data)) return;
+            if (failed) continue;
+
+            if (id == "SEND")
+            {
+                Pending p;
+                p.path = QString::fromUtf8(data.left(data.lastIndexOf(',')));
+                for (;;)
+                {
+                    if (!c.readSync(id, data)) return;
+                    if (id == "DONE") break;
+                    if (id != "DATA") return;
+                    p.data += data;
+                }
+                pending.push_back(p);
+                QMutexLocker lock(&mutex);
+                maxPending = qMax(maxPending, pending.size());
+                continue;
+            }
+
+            flush();
+            if (failed) continue;
+            auto path = QString::fromUtf8(data);
+            if (id == "STAT")
+            {
+                // v1跟随链接时路径末尾带'/'，只能查到目录
+                auto st = path.endsWith('/') ? (isDir(path) ? stat(path.left(path.size() - 1)) : QByteArray(12, 0)) : stat(path);
+                c.write("STAT" + st);
+            }
+            else if (id == "LIST")
+            {
+                QStringList names;
+                {
+                    QMutexLocker lock(&mutex);
+                    auto prefix = path + '/';
+                    for (auto it = files.lowerBound(prefix); it != files.end() && it.key().startsWith(prefix); ++it)
+                    {
+                        auto name = it.key().mid(prefix.size()).section('/', 0, 0);
+                        if (names.isEmpty() || names.last() != name) names.push_back(name);
+                    }
+                }
+                QByteArray out;
+                for (auto& name : names)
+                {
+                    auto n = name.toUtf8();
+                    out += "DENT" + stat(path + '/' + name) + Conn::le32(quint32(n.size())) + n;
+                }
+                c.write(out + "DONE" + QByteArray(16, 0));
+            }
+            else if (id == "RECV")
+            {
+                QByteArray content;
+                bool found;
+                {
+                    QMutexLocker lock(&mutex);
+                    found = files.contains(path);
+                    content = files.value(path);
+                }
+                if (!found)
+                {
+                    c.write(Conn::syncPacket("FAIL", "No such file or directory"));
+                    return;
+                }
+                for (int i = 0; i < content.size(); i += AdbSync::MaxChunk)
+                    c.write(Conn::syncPacket("DATA", content.mid(i, AdbSync::MaxChunk)));
+                c.write(Conn::syncPacket("DONE", 0));
+            }
+            else return;    // QUIT
+        }
+    }
+
+    void exec(Conn& c, const QByteArray& cmd)
+    {
+        QByteArray content;
+        int limit;
+        {
+            QMutexLocker lock(&mutex);
+            execs.push_back(cmd);
+            limit = truncateExec;
+        }
+        static const QRegularExpression re("^tail -c \\+(\\d+) '(.*)' 2>/dev/null$");
+        auto m = re.match(QString::fromUtf8(cmd));
+        if (!m.hasMatch()) return;
+        auto path = m.captured(2).replace("'\\''", "'");
+        {
+            QMutexLocker lock(&mutex);
+            content = files.value(path).mid(m.captured(1).toInt() - 1);
+        }
+        c.writeSplit(limit >= 0 ? content.left(limit) : content, 32 * 1024);
+    }
+};
+
+// FileTransfer 经由模拟的adb server上传下载: 连续上传不等应答、FAIL后重发其后的文件、断点续传
+class TestFileTransfer : public QObject
+{
+    Q_OBJECT
+
+    FakeAdbServer& server = FakeAdbServer::instance();
+    QScopedPointer<FakeSyncDevice> fake;
+    QScopedPointer<QTemporaryDir> tmp;
+    AdbDevice dev{ "emulator-5554" };
+
+    static QByteArray content(int n, int seed)
+    {
+        QByteArray b(n, Qt::Uninitialized);
+        for (int i = 0; i < n; ++i) b[i] = char((i * 131 + seed * 7) >> 3);
+        return b;
+    }
+
+    // 在本地临时目录下创建count个文件
+    QString makeLocal(const QString& dir, int count)
+    {
+        QDir(tmp->path()).mkpath(dir);
+        for (int i = 0; i < count; ++i)
+        {
+            QFile f(tmp->filePath(dir + QString("/f%1").arg(i)));
+            f.open(QIODevice::WriteOnly);
+            f.write(content(1000 + i * 37, i));
+        }
+        return tmp->filePath(dir);
+    }
+
+    // 已下载的部分及其对应的远端版本，FakeSyncDevice的修改时间固定为1500000000
+    void writePart(const QString& name, const QByteArray& data, int remoteSize, qint64 mtime = 1500000000)
+    {
+        QFile part(tmp->filePath(name + ".part"));
+        part.open(QIODevice::WriteOnly);
+        part.write(data);
+        QFile info(tmp->filePath(name + ".part.info"));
+        info.open(QIODevice::WriteOnly);
+        info.write(QByteArray::number(remoteSize) + ' ' + QByteArray::number(mtime));
+    }
+
+    static QByteArray readFile(const QString& path)
+    {
+        QFile f(path);
+        return f.open(QIODevice::ReadOnly) ? f.readAll() : QByteArray();
+    }
+
+    // 执行到结束，返回失败的文件
+    static QStringList run(FileTransfer& t)
+    {
+        QStringList failed;
+        connect(&t, &FileTransfer::fileFailed, [&](const QString& path, const QString&) { failed.push_back(path); });
+        QSignalSpy done(&t, &FileTransfer::finished);
+        t.start();
+        if (!done.wait(20 * 1000)) failed.push_back("timeout");
+        return failed;
+    }
+
+private Q_SLOTS:
+    void init()
+    {
+        fake.reset(new FakeSyncDevice);
+        tmp.reset(new QTemporaryDir);
+        auto d = fake.data();
+        server.setHandler([d](FakeAdbServer::Conn& c) { d->serve(c); });
+    }
+
+    void cleanup()
+    {
+        server.waitIdle();
+        server.setHandler(nullptr);
+    }
+
+    void pushPipelined()
+    {
+        auto local = makeLocal("up", 20);
+        FileTransfer t(&dev, nullptr, 1);
+        t.push(local, "/sdcard");
+        QCOMPARE(run(t), QStringList());
+        server.waitIdle();
+
+        QCOMPARE(fake->files.size(), 20);
+        for (int i = 0; i < 20; ++i)
+            QCOMPARE(fake->files.value(QString("/sdcard/up/f%1").arg(i)), content(1000 + i * 37, i));
+        QVERIFY(fake->maxPending > 1);
+        QCOMPARE(fake->syncConnections, 1);
+    }
+
+    // FAIL之后服务端关闭连接，已发出但未确认的上传在新连接上重发
+    void pushRequeueOnFail()
+    {
+        auto local = makeLocal("up", 6);
+        fake->failing.insert("/sdcard/up/f2");
+        FileTransfer t(&dev, nullptr, 1);
+        t.push(local, "/sdcard");
+        QCOMPARE(run(t), QStringList{ QDir(local).filePath("f2") });
+        server.waitIdle();
+
+        QCOMPARE(t.failedCount(), 1);
+        QCOMPARE(fake->files.size(), 5);
+        for (int i : { 0, 1, 3, 4, 5 })
+            QCOMPARE(fake->files.value(QString("/sdcard/up/f%1").arg(i)), content(1000 + i * 37, i));
+        QVERIFY(fake->syncConnections >= 2);
+    }
+
+    void pullDir()
+    {
+        fake->files["/data/d/a"] = content(200 * 1000, 1);
+        fake->files["/data/d/e"] = QByteArray();
+        fake->files["/data/d/sub/b"] = content(10, 2);
+        FileTransfer t(&dev, nullptr, 2);
+        t.pull("/data/d", tmp->path(), true);
+        QCOMPARE(run(t), QStringList());
+
+        QCOMPARE(readFile(tmp->filePath("d/a")), content(200 * 1000, 1));
+        QVERIFY(QFileInfo(tmp->filePath("d/e")).isFile());
+        QCOMPARE(readFile(tmp->filePath("d/sub/b")), content(10, 2));
+        QVERIFY(!QFile::exists(tmp->filePath("d/a.part")));
+        QVERIFY(!QFile::exists(tmp->filePath("d/a.part.info")));
+    }
+
+    // 文件名含单引号，已有的 .part 从断点接着下载
+    void resume()
+    {
+        QString remote = "/data/it's.bin";
+        auto data = content(300 * 1000, 3);
+        fake->files[remote] = data;
+        writePart("it's.bin", data.left(100000), data.size());
+        FileTransfer t(&dev, nullptr, 1);
+        t.pull(remote, tmp->path());
+        QCOMPARE(run(t), QStringList());
+
+        QCOMPARE(readFile(tmp->filePath("it's.bin")), data);
+        QVERIFY(!QFile::exists(tmp->filePath("it's.bin.part")));
+        QVERIFY(!QFile::exists(tmp->filePath("it's.bin.part.info")));
+        QCOMPARE(fake->execs, QByteArrayList{ "tail -c +100001 '/data/it'\\''s.bin' 2>/dev/null" });
+    }
+
+    // 续传的数据不完整时不能当作成功，.part 保留已收到的部分
+    void resumeTruncated()
+    {
+        QString remote = "/data/x.bin";
+        auto data = content(300 * 1000, 4);
+        fake->files[remote] = data;
+        fake->truncateExec = 1000;
+        writePart("x.bin", data.left(100000), data.size());
+        FileTransfer t(&dev, nullptr, 1);
+        t.pull(remote, tmp->path());
+        QCOMPARE(run(t), QStringList{ remote });
+
+        QVERIFY(!QFile::exists(tmp->filePath("x.bin")));
+        QCOMPARE(readFile(tmp->filePath("x.bin.part")), data.left(101000));
+        QVERIFY(QFile::exists(tmp->filePath("x.bin.part.info")));
+    }
+
+    // .part 来自远端文件的旧版本(修改时间不同，或没有记录)时从头下载，不能拼接
+    void resumeStale()
+    {
+        QString remote = "/data/y.bin";
+        auto data = content(300 * 1000, 5);
+        fake->files[remote] = data;
+        writePart("y.bin", content(100000, 6), data.size(), 1400000000);
+        QFile::copy(tmp->filePath("y.bin.part"), tmp->filePath("z.bin.part"));
+        fake->files["/data/z.bin"] = data;
+
+        FileTransfer t(&dev, nullptr, 1);
+        t.pull(remote, tmp->path());
+        t.pull("/data/z.bin", tmp->path());
+        QCOMPARE(run(t), QStringList());
+
+        QCOMPARE(readFile(tmp->filePath("y.bin")), data);
+        QCOMPARE(readFile(tmp->filePath("z.bin")), data);
+        QVERIFY(fake->execs.isEmpty());
+    }
+};
@@ -0,0 +1,24 @@
+#include <QtCore/QCoreApplication>
+#include <QtTest>
+
+#include "FakeAdbServer.h"
+#include "TestAdbClient.h"
+#include "BenchParse.h"
+#include "TestFastScan.h"
+#include "TestFileTransfer.h"
+
+// 依次执行各测试类，返回值为失败的测试类个数
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	// 须在AdbClient读取端口之前启动
+	FakeAdbServer::instance();
+
+	int failed = 0;
+	auto run = [&](QObject&& t) { failed += QTest::qExec(&t, argc, argv) != 0; };
+	run(TestAdbClient());
+	run(BenchParse());
+	run(TestFastScan());
+	run(TestFileTransfer());
+	return failed;
+}